@@ -115,6 +115,13 @@ class Bitboard
         return dir > 0 ? mask << dir : mask >> static_cast<int8_t>(-dir);
     }
 
+    template <Direction dir, Color color> constexpr Bitboard shift() const
+    {
+        if constexpr ((color == Colors::BLACK) == (dir > 0))
+            return mask >> (dir > 0 ? dir : -dir);
+        return mask << (dir > 0 ? dir : -dir);
+    }
+
     // Print bitboard for debugging
     void print()
     {
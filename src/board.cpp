@@ -6,7 +6,12 @@ namespace BBD
 
 const Bitboard Board::get_pinned_pieces() const
 {
-    const Color color = player_color(), enemy = color.flip();
+    return player_color() == Colors::WHITE ? get_pinned_pieces<Colors::WHITE>() : get_pinned_pieces<Colors::BLACK>();
+}
+
+template <Color color> const Bitboard Board::get_pinned_pieces() const
+{
+    constexpr Color enemy = color.flip();
     const Bitboard us = all_pieces(color), them = all_pieces(enemy);
     const Square king_square = pieces[color][PieceTypes::KING].lsb_index();
     Bitboard pinned(0ull);
@@ -27,7 +32,12 @@ const Bitboard Board::get_pinned_pieces() const
 
 const Bitboard Board::get_checkers() const
 {
-    const Color color = player_color(), enemy = color.flip();
+    return player_color() == Colors::WHITE ? get_checkers<Colors::WHITE>() : get_checkers<Colors::BLACK>();
+}
+
+template <Color color> const Bitboard Board::get_checkers() const
+{
+    constexpr Color enemy = color.flip();
     const Square king_square = pieces[color][PieceTypes::KING].lsb_index();
     const Bitboard occ = all_pieces(color) | all_pieces(enemy);
 
@@ -37,9 +47,20 @@ const Bitboard Board::get_checkers() const
            (orthogonal_sliders(enemy) & attacks::generate_attacks_rook(king_square, occ));
 }
 
+template const Bitboard Board::get_pinned_pieces<Colors::WHITE>() const;
+template const Bitboard Board::get_pinned_pieces<Colors::BLACK>() const;
+template const Bitboard Board::get_checkers<Colors::WHITE>() const;
+template const Bitboard Board::get_checkers<Colors::BLACK>() const;
+
 template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
 {
-    const Color color = player_color(), enemy = color.flip();
+    return player_color() == Colors::WHITE ? gen_legal_moves<Colors::WHITE, moves_type>(moves)
+                                           : gen_legal_moves<Colors::BLACK, moves_type>(moves);
+}
+
+template <Color color, int moves_type> int Board::gen_legal_moves(MoveList &moves)
+{
+    constexpr Color enemy = color.flip();
     const Square king_square = pieces[color][PieceTypes::KING].lsb_index();
     Bitboard us = all_pieces(color), them = all_pieces(enemy), occ = us | them, empty = ~occ;
     Bitboard attacked(0ull);
@@ -58,7 +79,7 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     // king moves
     {
         // pawn attacks
-        attacked = get_pawn_attacks(enemy);
+        attacked = get_pawn_attacks<enemy>();
 
         for (PieceType pt = PieceTypes::KNIGHT; pt <= PieceTypes::KING; pt++)
         {
@@ -80,7 +101,8 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     }
 
     Bitboard noisy_mask, quiet_mask;
-    int checkers_count = checkers().count();
+    const Bitboard checkers_mask = checkers();
+    int checkers_count = checkers_mask.count();
 
     if (checkers_count == 2)
     {
@@ -89,11 +111,11 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     }
     else if (checkers_count == 1)
     {
-        noisy_mask = checkers();
+        noisy_mask = checkers_mask;
         // can't do any non-king quiet move if we have a knight checking
-        quiet_mask = at(checkers().lsb_index()).type() == PieceTypes::KNIGHT
+        quiet_mask = at(checkers_mask.lsb_index()).type() == PieceTypes::KNIGHT
                          ? Bitboard(0ull)
-                         : attacks::between_mask[king_square][checkers().lsb_index()];
+                         : attacks::between_mask[king_square][checkers_mask.lsb_index()];
     }
     else
     {
@@ -103,8 +125,8 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
 
     const Bitboard pinned = pinned_pieces();
 
-    const int rank7 = color == Colors::WHITE ? 6 : 1, rank3 = color == Colors::WHITE ? 2 : 5;
-    const int file_a = color == Colors::WHITE ? 0 : 7, file_h = 7 - file_a;
+    constexpr int rank7 = color == Colors::WHITE ? 6 : 1, rank3 = color == Colors::WHITE ? 2 : 5;
+    constexpr int file_a = color == Colors::WHITE ? 0 : 7, file_h = 7 - file_a;
     const Bitboard pawns = pieces[color][PieceTypes::PAWN];
     const Bitboard non_promo_pawns = pawns & ~attacks::rank_mask[rank7],
                    promo_pawns = pawns & attacks::rank_mask[rank7];
@@ -112,21 +134,21 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     // pawn pushes
     if (moves_type & QUIET_MOVES)
     {
-        Bitboard single_push = non_promo_pawns.shift<NORTH>(color) & empty;
-        Bitboard double_push = (single_push & attacks::rank_mask[rank3]).shift<NORTH>(color) & empty & quiet_mask;
+        Bitboard single_push = non_promo_pawns.shift<NORTH, color>() & empty;
+        Bitboard double_push = (single_push & attacks::rank_mask[rank3]).shift<NORTH, color>() & empty & quiet_mask;
         single_push &= quiet_mask;
 
         while (single_push)
         {
             Square sq = single_push.lsb_index();
-            moves[nr_moves++] = Move(sq.shift<SOUTH>(color), sq, MoveTypes::NO_TYPE);
+            moves[nr_moves++] = Move(sq.shift<SOUTH, color>(), sq, MoveTypes::NO_TYPE);
             single_push ^= Bitboard(sq);
         }
 
         while (double_push)
         {
             Square sq = double_push.lsb_index();
-            moves[nr_moves++] = Move(sq.shift<SOUTH_SOUTH>(color), sq, MoveTypes::NO_TYPE);
+            moves[nr_moves++] = Move(sq.shift<SOUTH_SOUTH, color>(), sq, MoveTypes::NO_TYPE);
             double_push ^= Bitboard(sq);
         }
     }
@@ -134,20 +156,20 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     // pawn captures
     if (moves_type & CAPTURE_MOVES)
     {
-        Bitboard west_captured = (non_promo_pawns & ~attacks::file_mask[file_a]).shift<NORTHWEST>(color) & noisy_mask;
-        Bitboard east_captured = (non_promo_pawns & ~attacks::file_mask[file_h]).shift<NORTHEAST>(color) & noisy_mask;
+        Bitboard west_captured = (non_promo_pawns & ~attacks::file_mask[file_a]).shift<NORTHWEST, color>() & noisy_mask;
+        Bitboard east_captured = (non_promo_pawns & ~attacks::file_mask[file_h]).shift<NORTHEAST, color>() & noisy_mask;
 
         while (west_captured)
         {
             Square sq = west_captured.lsb_index();
-            moves[nr_moves++] = Move(sq.shift<SOUTHEAST>(color), sq, MoveTypes::NO_TYPE);
+            moves[nr_moves++] = Move(sq.shift<SOUTHEAST, color>(), sq, MoveTypes::NO_TYPE);
             west_captured ^= Bitboard(sq);
         }
 
         while (east_captured)
         {
             Square sq = east_captured.lsb_index();
-            moves[nr_moves++] = Move(sq.shift<SOUTHWEST>(color), sq, MoveTypes::NO_TYPE);
+            moves[nr_moves++] = Move(sq.shift<SOUTHWEST, color>(), sq, MoveTypes::NO_TYPE);
             east_captured ^= Bitboard(sq);
         }
     }
@@ -172,9 +194,9 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     // promotions
     if (moves_type & CAPTURE_MOVES)
     {
-        Bitboard west_promo = (promo_pawns & ~attacks::file_mask[file_a]).shift<NORTHWEST>(color) & noisy_mask;
-        Bitboard east_promo = (promo_pawns & ~attacks::file_mask[file_h]).shift<NORTHEAST>(color) & noisy_mask;
-        Bitboard quiet_promo = promo_pawns.shift<NORTH>(color) & quiet_mask;
+        Bitboard west_promo = (promo_pawns & ~attacks::file_mask[file_a]).shift<NORTHWEST, color>() & noisy_mask;
+        Bitboard east_promo = (promo_pawns & ~attacks::file_mask[file_h]).shift<NORTHEAST, color>() & noisy_mask;
+        Bitboard quiet_promo = promo_pawns.shift<NORTH, color>() & quiet_mask;
 
         auto add_promotions = [&](MoveList &moves, Square sq, Square sq_to) {
             moves[nr_moves++] = Move(sq, sq_to, MoveTypes::PROMO_KNIGHT);
@@ -187,21 +209,21 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
         while (quiet_promo)
         {
             Square sq = quiet_promo.lsb_index();
-            nr_moves = add_promotions(moves, sq.shift<SOUTH>(color), sq);
+            nr_moves = add_promotions(moves, sq.shift<SOUTH, color>(), sq);
             quiet_promo ^= Bitboard(sq);
         }
 
         while (west_promo)
         {
             Square sq = west_promo.lsb_index();
-            nr_moves = add_promotions(moves, sq.shift<SOUTHEAST>(color), sq);
+            nr_moves = add_promotions(moves, sq.shift<SOUTHEAST, color>(), sq);
             west_promo ^= Bitboard(sq);
         }
 
         while (east_promo)
         {
             Square sq = east_promo.lsb_index();
-            nr_moves = add_promotions(moves, sq.shift<SOUTHWEST>(color), sq);
+            nr_moves = add_promotions(moves, sq.shift<SOUTHWEST, color>(), sq);
             east_promo ^= Bitboard(sq);
         }
     }
@@ -252,17 +274,16 @@ template <int moves_type> int Board::gen_legal_moves(MoveList &moves)
     // castling
     if (moves_type & QUIET_MOVES)
     {
-        auto has_castling_right = [&](const int castle_rights, const Color color, const int side) {
-            return color == Colors::WHITE ? (castle_rights >> side) & 1 : (castle_rights >> (2 + side)) & 1;
-        };
+        // bit 0: WK, bit 1: WQ, bit 2: BK, bit 3: BQ
+        constexpr int castling_shift = color == Colors::WHITE ? 0 : 2;
         // king side
-        if (has_castling_right(get_castling_rights(), color, 0))
+        if ((get_castling_rights() >> castling_shift) & 1)
         {
             Bitboard b = attacks::between_mask[king_square][king_square + 3];
             if (!(attacked & (Bitboard(king_square) | b)) && !(occ & b))
                 moves[nr_moves++] = Move(king_square, king_square + 2, MoveTypes::CASTLE);
         }
-        if (has_castling_right(get_castling_rights(), color, 1))
+        if ((get_castling_rights() >> (castling_shift + 1)) & 1)
         {
             Bitboard b = attacks::between_mask[king_square][king_square - 3];
             if (!(attacked & (Bitboard(king_square) | b)) && !(occ & (Bitboard(king_square - 3) | b)))
@@ -276,6 +297,86 @@ template int Board::gen_legal_moves<CAPTURE_MOVES>(MoveList &moves);
 template int Board::gen_legal_moves<QUIET_MOVES>(MoveList &moves);
 template int Board::gen_legal_moves<ALL_MOVES>(MoveList &moves);
 
+// pieces of both colors attacking square, sliders see through the squares missing from occupied
+Bitboard Board::attackers_to(Square square, Bitboard occupied) const
+{
+    return (pieces[Colors::WHITE][PieceTypes::PAWN] & attacks::generate_attacks_pawn(Colors::BLACK, square)) |
+           (pieces[Colors::BLACK][PieceTypes::PAWN] & attacks::generate_attacks_pawn(Colors::WHITE, square)) |
+           ((pieces[Colors::WHITE][PieceTypes::KNIGHT] | pieces[Colors::BLACK][PieceTypes::KNIGHT]) &
+            attacks::knight_attacks[square]) |
+           ((pieces[Colors::WHITE][PieceTypes::KING] | pieces[Colors::BLACK][PieceTypes::KING]) &
+            attacks::king_attacks[square]) |
+           ((diagonal_sliders(Colors::WHITE) | diagonal_sliders(Colors::BLACK)) &
+            attacks::generate_attacks_bishop(square, occupied)) |
+           ((orthogonal_sliders(Colors::WHITE) | orthogonal_sliders(Colors::BLACK)) &
+            attacks::generate_attacks_rook(square, occupied));
+}
+
+bool Board::see(Move move, int threshold) const
+{
+    if (move.type() == MoveTypes::CASTLE)
+        return threshold <= 0;
+
+    const Square from = move.from(), to = move.to();
+
+    // swap is what we are up by if the opponent stops capturing now
+    int swap = (move.type() == MoveTypes::ENPASSANT ? see_values[PieceTypes::PAWN]
+                : at(to) != Pieces::NO_PIECE      ? see_values[at(to).type()]
+                                                  : 0) -
+               threshold;
+    if (swap < 0)
+        return false;
+
+    // even losing the capturing piece keeps us above the threshold
+    swap = see_values[at(from).type()] - swap;
+    if (swap <= 0)
+        return true;
+
+    const Bitboard diagonal = diagonal_sliders(Colors::WHITE) | diagonal_sliders(Colors::BLACK);
+    const Bitboard orthogonal = orthogonal_sliders(Colors::WHITE) | orthogonal_sliders(Colors::BLACK);
+
+    Bitboard occupied = (all_pieces(Colors::WHITE) | all_pieces(Colors::BLACK)) ^ Bitboard(from) ^ Bitboard(to);
+    if (move.type() == MoveTypes::ENPASSANT)
+        occupied ^= Bitboard(to.shift<SOUTH>(player_color()));
+    Bitboard attackers = attackers_to(to, occupied);
+
+    Color side = player_color();
+    bool result = true;
+    while (true)
+    {
+        side = side.flip();
+        attackers &= occupied;
+        const Bitboard side_attackers = attackers & all_pieces(side);
+        if (!side_attackers)
+            break;
+        result = !result;
+
+        // the least valuable attacker captures next, removing it can uncover sliders behind it
+        PieceType type = PieceTypes::PAWN;
+        while (!(side_attackers & pieces[side][type]))
+            type++;
+
+        if (type == PieceTypes::KING)
+        {
+            // the king can only capture if the square is no longer defended
+            if (attackers & all_pieces(side.flip()))
+                result = !result;
+            break;
+        }
+
+        swap = see_values[type] - swap;
+        if (swap < result)
+            break;
+
+        occupied ^= Bitboard((side_attackers & pieces[side][type]).lsb());
+        if (type == PieceTypes::PAWN || type == PieceTypes::BISHOP || type == PieceTypes::QUEEN)
+            attackers |= attacks::generate_attacks_bishop(to, occupied) & diagonal;
+        if (type == PieceTypes::ROOK || type == PieceTypes::QUEEN)
+            attackers |= attacks::generate_attacks_rook(to, occupied) & orthogonal;
+    }
+    return result;
+}
+
 // only needed for pawn moves really
 bool Board::is_legal(const Move &move) const
 {
@@ -3,6 +3,7 @@
 #include "attacks.h"
 #include "bitboard.h"
 #include "color.h"
+#include "cuckoo.h"
 #include "move.h"
 #include "network.h"
 #include "piece.h"
@@ -14,9 +15,46 @@
 namespace BBD
 {
 
-class Board
+// castling rights kept when a move starts or ends on a square, bit 0: WK, bit 1: WQ, bit 2: BK, bit 3: BQ
+constexpr std::array<uint8_t, 64> castling_rights_mask = [] {
+    std::array<uint8_t, 64> mask;
+    mask.fill(0b1111);
+    mask[Squares::A1] = 0b1101;
+    mask[Squares::E1] = 0b1100;
+    mask[Squares::H1] = 0b1110;
+    mask[Squares::A8] = 0b0111;
+    mask[Squares::E8] = 0b0011;
+    mask[Squares::H8] = 0b1011;
+    return mask;
+}();
+
+// piece values used by the static exchange evaluation, indexed by PieceType
+constexpr std::array<int, 6> see_values = {100, 300, 300, 500, 900, 0};
+
+// The part of the board that is snapshotted per ply when running in copy-make mode
+struct Position
+{
+    std::array<Piece, 64> squares;
+    std::array<std::array<Bitboard, 6>, 2> pieces;
+    std::array<Bitboard, 2> land;
+    Color current_color;
+    uint8_t castling_rights;
+    Square en_passant_square;
+    uint64_t cur_zobrist_hash;
+    uint64_t pawn_key;                     // pawns of both colors only
+    uint64_t material_key;                 // piece counts only, see Zobrist::material_keys
+    std::array<uint64_t, 2> non_pawn_keys; // pieces other than pawns, king included, per color
+};
+
+class Board : private Position
 {
   public:
+#ifdef COPY_MAKE
+    static constexpr bool copy_make = true;
+#else
+    static constexpr bool copy_make = false;
+#endif
+
     const uint8_t &get_castling_rights() const
     {
         return castling_rights;
@@ -27,21 +65,27 @@ class Board
         return en_passant_square;
     }
 
-    Bitboard &pinned_pieces()
-    {
-        return board_state_array.back().pinned_pieces;
-    }
+    /// Pinned pieces and checkers are computed on first access and cached in the current state,
+    /// so nodes that get cut before generating moves never pay for them
     const Bitboard pinned_pieces() const
     {
-        return board_state_array.back().pinned_pieces;
-    }
-    Bitboard &checkers()
-    {
-        return board_state_array.back().checkers;
+        const BoardState &state = board_state_array.back();
+        if (!state.has_pinned_pieces)
+        {
+            state.pinned_pieces = get_pinned_pieces();
+            state.has_pinned_pieces = true;
+        }
+        return state.pinned_pieces;
     }
     const Bitboard checkers() const
     {
-        return board_state_array.back().checkers;
+        const BoardState &state = board_state_array.back();
+        if (!state.has_checkers)
+        {
+            state.checkers = get_checkers();
+            state.has_checkers = true;
+        }
+        return state.checkers;
     }
     const Bitboard get_piece_bitboard(Color color, PieceType p) const
     {
@@ -51,6 +95,18 @@ class Board
     {
         return cur_zobrist_hash;
     }
+    const uint64_t get_pawn_key() const
+    {
+        return pawn_key;
+    }
+    const uint64_t get_material_key() const
+    {
+        return material_key;
+    }
+    const uint64_t get_non_pawn_key(Color color) const
+    {
+        return non_pawn_keys[color];
+    }
     int get_color()
     {
         return player_color();
@@ -65,6 +121,10 @@ class Board
         squares.fill(Pieces::NO_PIECE);
         board_state_array.clear();
         board_state_array.reserve(500);
+        hash_history.clear();
+        hash_history.reserve(500);
+        position_stack.clear();
+        position_stack.reserve(500);
 
         castling_rights = 0b1111;               // bit 0: WK, bit 1: WQ, bit 2: BK, bit 3: BQ
         en_passant_square = Squares::NO_SQUARE; // no square is available initially
@@ -128,10 +188,13 @@ class Board
         }
 
         cur_zobrist_hash = hash_calc();
-        BoardState current_state{Pieces::NO_PIECE, castling_rights, en_passant_square, cur_zobrist_hash};
+        pawn_key = pawn_key_calc();
+        material_key = material_key_calc();
+        non_pawn_keys = {non_pawn_key_calc(Colors::BLACK), non_pawn_key_calc(Colors::WHITE)};
+        BoardState current_state{Pieces::NO_PIECE, castling_rights, en_passant_square, cur_zobrist_hash, pawn_key,
+                                 material_key, non_pawn_keys};
         board_state_array.push_back(current_state);
-        checkers() = get_checkers();
-        pinned_pieces() = get_pinned_pieces();
+        hash_history.push_back(cur_zobrist_hash);
         accumulators.emplace_back();
         refresh_accumulators();
     };
@@ -148,6 +211,10 @@ class Board
         accumulators.clear();
         accumulators.reserve(300);
         board_state_array.clear();
+        hash_history.clear();
+        hash_history.reserve(500);
+        position_stack.clear();
+        position_stack.reserve(500);
         squares.fill(Pieces::NO_PIECE);
         pieces[Colors::WHITE].fill(Bitboard(0ull));
         pieces[Colors::BLACK].fill(Bitboard(0ull));
@@ -264,6 +331,8 @@ class Board
         // half move clock
         if (!halfmove_clock.empty())
             half_moves.push_back(std::stoi(halfmove_clock));
+        else
+            half_moves.push_back(0);
 
         // full move counter
         if (!fullmove_counter.empty())
@@ -278,11 +347,14 @@ class Board
         }
 
         cur_zobrist_hash = hash_calc();
+        pawn_key = pawn_key_calc();
+        material_key = material_key_calc();
+        non_pawn_keys = {non_pawn_key_calc(Colors::BLACK), non_pawn_key_calc(Colors::WHITE)};
 
-        BoardState current_state{Pieces::NO_PIECE, castling_rights, en_passant_square, cur_zobrist_hash};
+        BoardState current_state{Pieces::NO_PIECE, castling_rights, en_passant_square, cur_zobrist_hash, pawn_key,
+                                 material_key, non_pawn_keys};
         board_state_array.push_back(current_state);
-        checkers() = get_checkers();
-        pinned_pieces() = get_pinned_pieces();
+        hash_history.push_back(cur_zobrist_hash);
         accumulators.emplace_back();
         refresh_accumulators();
     };
@@ -306,15 +378,7 @@ class Board
 
         // castling
         // bit 0: WK, bit 1: WQ, bit 2: BK, bit 3: BQ
-        // uint8_t castling_rights = get_castling_rights();
-        if (0b0001 & castling_rights)
-            hash ^= BBD::Zobrist::castling_keys[0];
-        if ((1 << 1) & castling_rights)
-            hash ^= BBD::Zobrist::castling_keys[1];
-        if ((1 << 2) & castling_rights)
-            hash ^= BBD::Zobrist::castling_keys[2];
-        if ((1 << 3) & castling_rights)
-            hash ^= BBD::Zobrist::castling_keys[3];
+        hash ^= BBD::Zobrist::castling_keys[castling_rights];
 
         // en_passant
         // Square en_passant = get_en_passant_square();
@@ -326,262 +390,158 @@ class Board
         return hash;
     }
 
-    /// Updates the Board, assuming the move is legal
-    /// \param move
-    /// \return
-    void make_move(const Move &move)
+    uint64_t pawn_key_calc() const
     {
-        accumulators.push_back(accumulators.back());
-        auto &accumulator = accumulators.back();
-
-        // zobrist incremental update (part 1)
-        uint64_t new_zobrsist_hash = cur_zobrist_hash;
-        new_zobrsist_hash ^= BBD::Zobrist::black_to_move;
-        if (en_passant_square != Squares::NO_SQUARE)
+        uint64_t key = 0;
+        for (Square sq = Squares::A1; sq <= Squares::H8; sq++)
         {
-            new_zobrsist_hash ^= BBD::Zobrist::en_passant_keys[en_passant_square];
+            if (at(sq) != Pieces::NO_PIECE && at(sq).type() == PieceTypes::PAWN)
+                key ^= BBD::Zobrist::piece_square_keys[64 * int(at(sq)) + sq];
         }
+        return key;
+    }
 
-        // clear previous target en_passant
-        en_passant_square = Squares::NO_SQUARE;
-
-        Square from = move.from();
-        Square to = move.to();
-        Piece captured = Pieces::NO_PIECE;
-
-        // castling 0x1111 - bit 0: WK, bit 1: WQ, bit 2: BK, bit 3: BQ
-        // update castling when King moves
-        if (squares[from].type() == PieceTypes::KING)
-        {
-            if (current_color == Colors::WHITE)
-            {
-                castling_rights &= 0b1100; // remove for white
-            }
-            else
-            {
-                castling_rights &= 0b0011; // remove for black
-            }
-        }
-        // update castling when Rook moves
-        if (squares[from].type() == PieceTypes::ROOK)
+    uint64_t non_pawn_key_calc(Color color) const
+    {
+        uint64_t key = 0;
+        for (Square sq = Squares::A1; sq <= Squares::H8; sq++)
         {
-            if (from == Squares::A1 && current_color == Colors::WHITE)
-            { // White queen side
-                castling_rights &= 0b1101;
-            }
-            else if (from == Squares::H1 && current_color == Colors::WHITE)
-            { // White king side
-                castling_rights &= 0b1110;
-            }
-            else if (from == Squares::A8 && current_color == Colors::BLACK)
-            { // Black queen side
-                castling_rights &= 0b0111;
-            }
-            else if (from == Squares::H8 && current_color == Colors::BLACK)
-            { // Black king side
-                castling_rights &= 0b1011;
-            }
-        }
-
-        // update bitmap for captured piece
-        if (squares[to] != Pieces::NO_PIECE)
-        {
-            pieces[current_color.flip()][squares[to].type()].set_bit(to, false);
-
-            // zobrist incremental update (part 2)
-            new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(to)) + to];
-
-            land[current_color.flip()].set_bit(to, false);
-            captured = squares[to];
-            accumulator[0].remove_feature(feature_index(squares[to], to, Colors::BLACK));
-            accumulator[1].remove_feature(feature_index(squares[to], to, Colors::WHITE));
+            if (at(sq) != Pieces::NO_PIECE && at(sq).type() != PieceTypes::PAWN && at(sq).color() == color)
+                key ^= BBD::Zobrist::piece_square_keys[64 * int(at(sq)) + sq];
         }
+        return key;
+    }
 
-        // update castling when Rook is captured
-        if (captured.type() == PieceTypes::ROOK)
+    uint64_t material_key_calc() const
+    {
+        uint64_t key = 0;
+        for (Color color : {Colors::BLACK, Colors::WHITE})
         {
-            Color color_captured = captured.color();
-            if (color_captured == Colors::WHITE)
-            {
-                if (to == Squares::A1)
-                { // White queen side
-                    castling_rights &= 0b1101;
-                }
-                else if (to == Squares::H1)
-                { // White king side
-                    castling_rights &= 0b1110;
-                }
-            }
-            else if (color_captured == Colors::BLACK)
+            for (PieceType type = PieceTypes::PAWN; type <= PieceTypes::KING; type++)
             {
-                if (to == Squares::A8)
-                { // Black queen side
-                    castling_rights &= 0b0111;
-                }
-                else if (to == Squares::H8)
-                { // Black king side
-                    castling_rights &= 0b1011;
-                }
+                const int piece = 2 * type + color;
+                for (int count = 0; count < pieces[color][type].count(); count++)
+                    key ^= BBD::Zobrist::material_keys[16 * piece + count];
             }
         }
+        return key;
+    }
 
-        // zobrist incremental update (part 3)
-        if (board_state_array.back().castling != castling_rights)
-        {
-            // previous casting rights
-            if (0b0001 & board_state_array.back().castling)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[0];
-            if ((1 << 1) & board_state_array.back().castling)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[1];
-            if ((1 << 2) & board_state_array.back().castling)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[2];
-            if ((1 << 3) & board_state_array.back().castling)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[3];
-
-            // new castling rights
-            if (0b0001 & castling_rights)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[0];
-            if ((1 << 1) & castling_rights)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[1];
-            if ((1 << 2) & castling_rights)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[2];
-            if ((1 << 3) & castling_rights)
-                new_zobrsist_hash ^= BBD::Zobrist::castling_keys[3];
-        }
+    /// Updates the Board, assuming the move is legal
+    /// \param move
+    /// \return
+    void make_move(const Move &move)
+    {
+        if (current_color == Colors::WHITE)
+            make_move<Colors::WHITE>(move);
+        else
+            make_move<Colors::BLACK>(move);
+    }
 
+    /// Colour-specialised make_move, color must be the side to move
+    template <Color color> void make_move(const Move &move)
+    {
         switch (move.type())
         {
-        case CASTLE:
-            pieces[current_color][PieceTypes::KING].set_bit(from, false);
-            pieces[current_color][PieceTypes::KING].set_bit(to, true);
-
-            // zobrist incremental update part 4
-            new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(from)) + from];
-            new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(from)) + to];
-
-            accumulator[0].remove_feature(feature_index(at(from), from, Colors::BLACK));
-            accumulator[1].remove_feature(feature_index(at(from), from, Colors::WHITE));
-            accumulator[0].add_feature(feature_index(at(from), to, Colors::BLACK));
-            accumulator[1].add_feature(feature_index(at(from), to, Colors::WHITE));
-
-            land[current_color].set_bit(from, false);
-            land[current_color].set_bit(to, true);
-
-            std::swap(squares[from], squares[to]);
-            // queen's side
-            if (to < from)
-            {
-                from = player_color() == Colors::WHITE ? Squares::A1 : Squares::A8;
-                to = player_color() == Colors::WHITE ? Squares::D1 : Squares::D8;
-            }
+        case NO_TYPE:
+            if (squares[move.to()] == Pieces::NO_PIECE)
+                make_move<color, QUIET>(move);
             else
-            {
-                from = player_color() == Colors::WHITE ? Squares::H1 : Squares::H8;
-                to = player_color() == Colors::WHITE ? Squares::F1 : Squares::F8;
-            }
+                make_move<color, CAPTURE>(move);
             break;
-
-        case ENPASSANT: {
-            auto to_pos = to + 8 - 16 * current_color;
-            pieces[current_color.flip()][PieceTypes::PAWN].set_bit(to_pos, false);
-
-            // zobrist incremental update part 5
-            new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(to_pos)) + to_pos];
-
-            accumulator[0].remove_feature(feature_index(at(to_pos), to_pos, Colors::BLACK));
-            accumulator[1].remove_feature(feature_index(at(to_pos), to_pos, Colors::WHITE));
-
-            land[current_color.flip()].set_bit(to_pos, false);
-            captured = squares[to_pos];
-            squares[to_pos] = Pieces::NO_PIECE;
+        case CASTLE:
+            make_move<color, CASTLING>(move);
+            break;
+        case ENPASSANT:
+            make_move<color, EN_PASSANT>(move);
+            break;
+        default:
+            make_move<color, PROMOTION>(move);
             break;
         }
-        case PROMO_KNIGHT:
-        case PROMO_BISHOP:
-        case PROMO_ROOK:
-        case PROMO_QUEEN:
-            pieces[current_color][PieceTypes::PAWN].set_bit(from, false);
+    }
 
-            // zobrist incremental update part 6
-            new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(from)) + from];
+    /// Fast path for a single move category (see MoveCategories)
+    template <Color color, int category> void make_move(const Move &move)
+    {
+        constexpr Color enemy = color.flip();
 
-            accumulator[0].remove_feature(feature_index(at(from), from, Colors::BLACK));
-            accumulator[1].remove_feature(feature_index(at(from), from, Colors::WHITE));
+        if constexpr (copy_make)
+            position_stack.push_back(*this);
+        accumulators.push_back(accumulators.back());
 
-            land[current_color].set_bit(from, false);
-            squares[from] = (current_color ? Piece(2 * move.promotion_piece() + 1) : Piece(2 * move.promotion_piece()));
-            pieces[current_color][move.promotion_piece()].set_bit(to, true);
+        const Square from = move.from(), to = move.to();
+        const Piece piece = squares[from];
+        Piece captured = Pieces::NO_PIECE;
 
-            // zobrist incremetal update part 7
-            new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(from)) + from];
+        // zobrist: side to move, old castling rights and old en passant square go out
+        cur_zobrist_hash ^= Zobrist::black_to_move ^ Zobrist::castling_keys[castling_rights];
+        if (en_passant_square != Squares::NO_SQUARE)
+            cur_zobrist_hash ^= Zobrist::en_passant_keys[en_passant_square];
+        en_passant_square = Squares::NO_SQUARE;
 
-            accumulator[0].add_feature(feature_index(at(from), from, Colors::BLACK));
-            accumulator[1].add_feature(feature_index(at(from), from, Colors::WHITE));
-            // new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[at(from) * 64 + to];
+        // castling 0x1111 - bit 0: WK, bit 1: WQ, bit 2: BK, bit 3: BQ
+        castling_rights &= castling_rights_mask[from] & castling_rights_mask[to];
 
-            land[current_color].set_bit(to, true);
-            break;
+        if constexpr (category == CAPTURE || category == PROMOTION)
+        {
+            captured = squares[to];
+            if (category == CAPTURE || captured != Pieces::NO_PIECE)
+                remove_piece<enemy>(captured, to);
         }
-
-        // check for 2 square move
-        if (squares[from].type() == PieceTypes::PAWN && std::abs((int)from - (int)to) == 16)
+        else if constexpr (category == EN_PASSANT)
         {
-            // board_state_array.back().en_passant = (to + from) / 2;
-            en_passant_square = Square(((int)to + (int)from) / 2); // we update it for the next move
+            const Square captured_square = to.shift<SOUTH, color>();
+            captured = squares[captured_square];
+            remove_piece<enemy>(captured, captured_square);
         }
 
-        // update the bitmap for moving piece
-        pieces[current_color][squares[from].type()].set_bit(from, false);
-        pieces[current_color][squares[from].type()].set_bit(to, true);
+        if constexpr (category == PROMOTION)
+        {
+            remove_piece<color>(piece, from);
+            add_piece<color>(Piece(2 * move.promotion_piece() + color), to);
+        }
+        else
+        {
+            move_piece<color>(piece, from, to);
+        }
 
-        // zobrist incremetal update part 8
-        new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(from)) + from];
-        new_zobrsist_hash ^= BBD::Zobrist::piece_square_keys[64 * int(at(from)) + to];
+        if constexpr (category == CASTLING)
+        {
+            // queen's side if the king goes left
+            const Square rook_from = to < from ? to - 2 : to + 1, rook_to = to < from ? to + 1 : to - 1;
+            move_piece<color>(squares[rook_from], rook_from, rook_to);
+        }
+        else if constexpr (category == QUIET)
+        {
+            // check for 2 square move
+            if (piece.type() == PieceTypes::PAWN && (from ^ to) == 16)
+                en_passant_square = Square((int(from) + int(to)) / 2); // we update it for the next move
+        }
 
-        land[current_color].set_bit(from, false);
-        land[current_color].set_bit(to, true);
+        // zobrist: new castling rights and new en passant square go in
+        cur_zobrist_hash ^= Zobrist::castling_keys[castling_rights];
+        if (en_passant_square != Squares::NO_SQUARE)
+            cur_zobrist_hash ^= Zobrist::en_passant_keys[en_passant_square];
 
-        if (squares[from].type() == PieceTypes::PAWN)
+        // pawn moves and captures are irreversible, they start a new half move segment
+        if (category == CAPTURE || piece.type() == PieceTypes::PAWN)
             half_moves.push_back(-1);
-
-        accumulator[0].remove_feature(feature_index(squares[from], from, Colors::BLACK));
-        accumulator[1].remove_feature(feature_index(squares[from], from, Colors::WHITE));
-        accumulator[0].add_feature(feature_index(squares[from], to, Colors::BLACK));
-        accumulator[1].add_feature(feature_index(squares[from], to, Colors::WHITE));
-
-        // make move
-        std::swap(squares[to], squares[from]);
-        squares[from] = Pieces::NO_PIECE;
-
         half_moves.back()++;
-        if (current_color == Colors::BLACK)
+        if constexpr (color == Colors::BLACK)
             full_moves++;
 
-        current_color = current_color.flip();
-
-        // zobrist incremetal update part 9
-        if (en_passant_square != Squares::NO_SQUARE)
-        {
-            new_zobrsist_hash ^= BBD::Zobrist::en_passant_keys[en_passant_square];
-        }
+        current_color = enemy;
 
-        // cur_zobrist_hash = hash_calc();
-        cur_zobrist_hash = new_zobrsist_hash;
-        // hash_cnt[cur_zobrist_hash]++;
-
-        // record the board state before the move is made
-        BoardState current_state{captured, castling_rights, en_passant_square, cur_zobrist_hash};
         // record the current state
-        board_state_array.push_back(current_state);
-
-        pinned_pieces() = get_pinned_pieces();
-        checkers() = get_checkers();
+        board_state_array.emplace_back(captured, castling_rights, en_passant_square, cur_zobrist_hash, pawn_key,
+                                       material_key, non_pawn_keys);
+        hash_history.push_back(cur_zobrist_hash);
     };
 
     void make_null_move()
     {
         accumulators.push_back(accumulators.back());
-        en_passant_square = Squares::NO_SQUARE;
 
         // zobrist incremental update (part 1)
         uint64_t new_zobrsist_hash = cur_zobrist_hash;
@@ -590,117 +550,139 @@ class Board
         {
             new_zobrsist_hash ^= BBD::Zobrist::en_passant_keys[en_passant_square];
         }
+        en_passant_square = Squares::NO_SQUARE;
 
-        half_moves.back()++;
+        // repetitions can't span a null move, so it starts a new half move segment
+        half_moves.push_back(0);
         if (current_color == Colors::BLACK)
             full_moves++;
 
         current_color = current_color.flip();
         cur_zobrist_hash = new_zobrsist_hash;
-        board_state_array.emplace_back(Pieces::NO_PIECE, castling_rights, en_passant_square, cur_zobrist_hash);
-        pinned_pieces() = get_pinned_pieces();
-        checkers() = get_checkers();
+        board_state_array.emplace_back(Pieces::NO_PIECE, castling_rights, en_passant_square, cur_zobrist_hash,
+                                       pawn_key, material_key, non_pawn_keys);
+        hash_history.push_back(cur_zobrist_hash);
     }
+
     /// Updates the Board, assuming the move is legal
     /// \param move
     /// \return
     void undo_move(const Move &move)
     {
+        if (current_color == Colors::WHITE)
+            undo_move<Colors::BLACK>(move);
+        else
+            undo_move<Colors::WHITE>(move);
+    }
+
+    /// Colour-specialised undo_move, color must be the side that made the move
+    template <Color color> void undo_move(const Move &move)
+    {
+        if constexpr (copy_make)
+        {
+            accumulators.pop_back();
+            board_state_array.pop_back();
+            hash_history.pop_back();
+            if constexpr (color == Colors::BLACK)
+                full_moves--;
+            half_moves.back()--;
+            if (half_moves.back() == -1)
+                half_moves.pop_back();
+
+            static_cast<Position &>(*this) = position_stack.back();
+            position_stack.pop_back();
+            return;
+        }
+
+        switch (move.type())
+        {
+        case NO_TYPE:
+            if (board_state_array.back().captured == Pieces::NO_PIECE)
+                undo_move<color, QUIET>(move);
+            else
+                undo_move<color, CAPTURE>(move);
+            break;
+        case CASTLE:
+            undo_move<color, CASTLING>(move);
+            break;
+        case ENPASSANT:
+            undo_move<color, EN_PASSANT>(move);
+            break;
+        default:
+            undo_move<color, PROMOTION>(move);
+            break;
+        }
+    }
+
+    /// Fast path for a single move category (see MoveCategories)
+    template <Color color, int category> void undo_move(const Move &move)
+    {
+        constexpr Color enemy = color.flip();
+
         accumulators.pop_back();
-        Piece prev_captured = board_state_array.back().captured;
+        const Piece captured = board_state_array.back().captured;
         board_state_array.pop_back();
+        hash_history.pop_back();
 
-        Square from = move.from();
-        Square to = move.to();
+        const Square from = move.from(), to = move.to();
+        const Bitboard from_to = Bitboard(from) | Bitboard(to);
 
-        if (current_color == Colors::WHITE)
+        if constexpr (color == Colors::BLACK)
             full_moves--;
         half_moves.back()--;
         if (half_moves.back() == -1)
             half_moves.pop_back();
 
-        current_color = current_color.flip();
+        current_color = color;
 
         // previous state
-        BoardState prev_state = board_state_array.back();
+        const BoardState &prev_state = board_state_array.back();
         en_passant_square = prev_state.en_passant;
         castling_rights = prev_state.castling;
         cur_zobrist_hash = prev_state.zobrist_hash;
+        pawn_key = prev_state.pawn_key;
+        material_key = prev_state.material_key;
+        non_pawn_keys = prev_state.non_pawn_keys;
 
-        switch (move.type())
+        if constexpr (category == PROMOTION)
         {
-        case CASTLE:
-            pieces[current_color][PieceTypes::KING].set_bit(from, true);
-            pieces[current_color][PieceTypes::KING].set_bit(to, false);
-            std::swap(squares[from], squares[to]);
-
-            land[current_color].set_bit(from, true);
-            land[current_color].set_bit(to, false);
-            // queen's side
-            if (to < from)
-            {
-                from = player_color() == Colors::WHITE ? Squares::A1 : Squares::A8;
-                to = player_color() == Colors::WHITE ? Squares::D1 : Squares::D8;
-            }
-            else
-            {
-                from = player_color() == Colors::WHITE ? Squares::H1 : Squares::H8;
-                to = player_color() == Colors::WHITE ? Squares::F1 : Squares::F8;
-            }
-            break;
-        case ENPASSANT: {
-            auto to_pos = to + 8 - 16 * current_color;
-            pieces[current_color.flip()][PieceTypes::PAWN].set_bit(to_pos, true);
-            land[current_color.flip()].set_bit(to_pos, true);
-            squares[to_pos] = prev_captured;
-            break;
+            pieces[color][move.promotion_piece()].set_bit(to, false);
+            pieces[color][PieceTypes::PAWN].set_bit(from, true);
+            squares[from] = color == Colors::WHITE ? Pieces::WHITE_PAWN : Pieces::BLACK_PAWN;
         }
-        case PROMO_KNIGHT:
-        case PROMO_BISHOP:
-        case PROMO_ROOK:
-        case PROMO_QUEEN:
-            auto promotion_piece_type = move.promotion_piece();
-            pieces[current_color][promotion_piece_type].set_bit(to, false);
-            land[current_color].set_bit(to, false);
-            squares[from] = prev_captured;
-            if (prev_captured != Pieces::NO_PIECE)
-            {
-                pieces[current_color.flip()][prev_captured.type()].set_bit(to, true);
-                land[current_color.flip()].set_bit(to, true);
-            }
-            if (current_color == Colors::WHITE)
-            {
-                squares[to] = Pieces::WHITE_PAWN;
-            }
-            else
-            {
-                squares[to] = Pieces::BLACK_PAWN;
-            }
-            break;
-        }
-        pieces[current_color][squares[to].type()].set_bit(to, false);
-        pieces[current_color][squares[to].type()].set_bit(from, true);
-
-        land[current_color].set_bit(to, false);
-        land[current_color].set_bit(from, true);
-
-        if (move.type() == ENPASSANT)
+        else
         {
+            pieces[color][squares[to].type()] ^= from_to;
             squares[from] = squares[to];
-            squares[to] = Pieces::NO_PIECE;
         }
-        else
-        {
-            // undo move
-            std::swap(squares[to], squares[from]);
+        land[color] ^= from_to;
+        squares[to] = Pieces::NO_PIECE;
 
-            squares[to] = prev_captured;
-            if (squares[to] != Pieces::NO_PIECE)
+        if constexpr (category == CAPTURE || category == PROMOTION)
+        {
+            if (category == CAPTURE || captured != Pieces::NO_PIECE)
             {
-                pieces[current_color.flip()][squares[to].type()].set_bit(to, true);
-                land[current_color.flip()].set_bit(to, true);
+                squares[to] = captured;
+                pieces[enemy][captured.type()].set_bit(to, true);
+                land[enemy].set_bit(to, true);
             }
         }
+        else if constexpr (category == EN_PASSANT)
+        {
+            const Square captured_square = to.shift<SOUTH, color>();
+            squares[captured_square] = captured;
+            pieces[enemy][PieceTypes::PAWN].set_bit(captured_square, true);
+            land[enemy].set_bit(captured_square, true);
+        }
+        else if constexpr (category == CASTLING)
+        {
+            const Square rook_from = to < from ? to - 2 : to + 1, rook_to = to < from ? to + 1 : to - 1;
+            const Bitboard rook_from_to = Bitboard(rook_from) | Bitboard(rook_to);
+            pieces[color][PieceTypes::ROOK] ^= rook_from_to;
+            land[color] ^= rook_from_to;
+            squares[rook_from] = squares[rook_to];
+            squares[rook_to] = Pieces::NO_PIECE;
+        }
     };
 
     /// Updates the Board for null move
@@ -709,10 +691,11 @@ class Board
     {
         accumulators.pop_back();
         board_state_array.pop_back();
+        hash_history.pop_back();
 
         if (current_color == Colors::WHITE)
             full_moves--;
-        half_moves.back()--;
+        half_moves.pop_back();
 
         current_color = current_color.flip();
 
@@ -722,33 +705,139 @@ class Board
         cur_zobrist_hash = prev_state.zobrist_hash;
     }
 
-    bool threefold_check()
+    /// Checks for a repetition, only looking back to the last irreversible move and only at positions
+    /// with the same side to move. One earlier occurrence less than ply plies ago (inside the search tree)
+    /// is enough, older ones need to be seen twice
+    /// \param ply distance from the search root
+    /// \return
+    bool is_repetition(int ply) const
     {
+        const int last = static_cast<int>(hash_history.size()) - 1;
+        const int window = std::min(half_moves.back(), last);
         int cnt = 0;
-        for (auto it : board_state_array)
+        for (int distance = 2; distance <= window; distance += 2)
+        {
+            if (hash_history[last - distance] == cur_zobrist_hash)
+            {
+                if (distance < ply || ++cnt == 2)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    /// Checks if the side to move can reach a position from the reversible history with its next move,
+    /// in which case it can claim at least a draw. Uses the cuckoo tables, see cuckoo.h
+    /// \param ply distance from the root, positions reached before the root need to have been repeated already
+    bool has_upcoming_repetition(int ply) const
+    {
+        const int last = static_cast<int>(hash_history.size()) - 1;
+        const int window = std::min(half_moves.back(), last);
+        const Bitboard occupied = land[Colors::WHITE] | land[Colors::BLACK];
+        for (int distance = 3; distance <= window; distance += 2)
         {
-            cnt += (it.zobrist_hash == cur_zobrist_hash);
-            if (cnt == 3)
+            const uint64_t move_key = cur_zobrist_hash ^ hash_history[last - distance];
+            size_t index = Cuckoo::h1(move_key);
+            if (Cuckoo::keys[index] != move_key)
             {
+                index = Cuckoo::h2(move_key);
+                if (Cuckoo::keys[index] != move_key)
+                    continue;
+            }
+
+            const Move move = Cuckoo::moves[index];
+            if (attacks::between_mask[move.from()][move.to()] & occupied)
+                continue;
+            if (distance < ply)
                 return true;
+
+            // before the root the move has to be ours and the position it leads to has to be a repetition itself
+            const Piece piece = squares[move.from()] != Pieces::NO_PIECE ? squares[move.from()] : squares[move.to()];
+            if (piece.color() != current_color)
+                continue;
+            for (int earlier = distance + 2; earlier <= window; earlier += 2)
+            {
+                if (hash_history[last - earlier] == hash_history[last - distance])
+                    return true;
             }
         }
         return false;
     }
 
+    bool threefold_check() const
+    {
+        return is_repetition(0);
+    }
+
+    /// Checks for a draw by the fifty-move rule. The clock restarts after a null move,
+    /// so inside null move subtrees this can only miss draws, never claim false ones
+    /// \return
+    bool is_fifty_move_draw()
+    {
+        if (half_moves.back() < 100)
+            return false;
+        if (!checkers())
+            return true;
+
+        // checkmate takes precedence
+        MoveList moves;
+        const int nr_moves = gen_legal_moves<ALL_MOVES>(moves);
+        for (int i = 0; i < nr_moves; i++)
+        {
+            if (is_legal(moves[i]))
+                return true;
+        }
+        return false;
+    }
+
+    /// Checks if neither side has enough material to mate: only kings and at most one minor piece,
+    /// or only bishops that all stand on squares of the same color
+    /// \return
+    bool is_insufficient_material() const
+    {
+        using namespace PieceTypes;
+        if (pieces[Colors::WHITE][PAWN] | pieces[Colors::BLACK][PAWN] | pieces[Colors::WHITE][ROOK] |
+            pieces[Colors::BLACK][ROOK] | pieces[Colors::WHITE][QUEEN] | pieces[Colors::BLACK][QUEEN])
+            return false;
+
+        const Bitboard bishops = pieces[Colors::WHITE][BISHOP] | pieces[Colors::BLACK][BISHOP];
+        const Bitboard minors = bishops | pieces[Colors::WHITE][KNIGHT] | pieces[Colors::BLACK][KNIGHT];
+        if (minors.count() <= 1)
+            return true;
+
+        constexpr Bitboard light_squares = 0x55AA55AA55AA55AAull;
+        return minors == bishops && (!(bishops & light_squares) || !(bishops & ~light_squares));
+    }
+
     const Bitboard get_pinned_pieces() const;
+    template <Color color> const Bitboard get_pinned_pieces() const;
 
     const Bitboard get_checkers() const;
+    template <Color color> const Bitboard get_checkers() const;
 
-    const Bitboard get_pawn_attacks(const Color &color) const
+    template <Color color> const Bitboard get_pawn_attacks() const
     {
         const Bitboard pawns = pieces[color][PieceTypes::PAWN];
-        const int file_a = color == Colors::WHITE ? 0 : 7, file_h = 7 - file_a;
-        return (pawns & ~attacks::file_mask[file_a]).shift<NORTHWEST>(color) |
-               (pawns & ~attacks::file_mask[file_h]).shift<NORTHEAST>(color);
+        constexpr int file_a = color == Colors::WHITE ? 0 : 7, file_h = 7 - file_a;
+        return (pawns & ~attacks::file_mask[file_a]).shift<NORTHWEST, color>() |
+               (pawns & ~attacks::file_mask[file_h]).shift<NORTHEAST, color>();
     }
 
+    /// Returns the pieces of both colors that attack square, with occupied as the blockers
+    /// \param square
+    /// \param occupied
+    /// \return
+    Bitboard attackers_to(Square square, Bitboard occupied) const;
+
+    /// Static exchange evaluation, checks if the sequence of captures on the target square
+    /// started by move wins at least threshold for the side to move
+    /// \param move
+    /// \param threshold
+    /// \return
+    bool see(Move move, int threshold) const;
+
     template <int moves_type> int gen_legal_moves(MoveList &moves);
+    template <Color color, int moves_type> int gen_legal_moves(MoveList &moves);
 
     /// Checks if the move is legal
     /// \param move
@@ -829,14 +918,61 @@ class Board
     }
 
   private:
-    std::array<Piece, 64> squares;
-    std::array<std::array<Bitboard, 6>, 2> pieces;
-    std::array<Bitboard, 2> land;
-    Color current_color;
-    uint8_t castling_rights;
-    Square en_passant_square;
-    uint64_t cur_zobrist_hash;
+    /// Helpers for make_move, keeping mailbox, bitboards, hash and accumulators in sync
+    template <Color color> void add_piece(Piece piece, Square sq)
+    {
+        squares[sq] = piece;
+        material_key ^= Zobrist::material_keys[16 * int(piece) + pieces[color][piece.type()].count()];
+        pieces[color][piece.type()].set_bit(sq, true);
+        land[color].set_bit(sq, true);
+        cur_zobrist_hash ^= Zobrist::piece_square_keys[64 * int(piece) + sq];
+        if (piece.type() == PieceTypes::PAWN)
+            pawn_key ^= Zobrist::piece_square_keys[64 * int(piece) + sq];
+        else
+            non_pawn_keys[color] ^= Zobrist::piece_square_keys[64 * int(piece) + sq];
+        auto &accumulator = accumulators.back();
+        accumulator[0].add_feature(feature_index(piece, sq, Colors::BLACK));
+        accumulator[1].add_feature(feature_index(piece, sq, Colors::WHITE));
+    }
+
+    template <Color color> void remove_piece(Piece piece, Square sq)
+    {
+        squares[sq] = Pieces::NO_PIECE;
+        pieces[color][piece.type()].set_bit(sq, false);
+        material_key ^= Zobrist::material_keys[16 * int(piece) + pieces[color][piece.type()].count()];
+        land[color].set_bit(sq, false);
+        cur_zobrist_hash ^= Zobrist::piece_square_keys[64 * int(piece) + sq];
+        if (piece.type() == PieceTypes::PAWN)
+            pawn_key ^= Zobrist::piece_square_keys[64 * int(piece) + sq];
+        else
+            non_pawn_keys[color] ^= Zobrist::piece_square_keys[64 * int(piece) + sq];
+        auto &accumulator = accumulators.back();
+        accumulator[0].remove_feature(feature_index(piece, sq, Colors::BLACK));
+        accumulator[1].remove_feature(feature_index(piece, sq, Colors::WHITE));
+    }
+
+    template <Color color> void move_piece(Piece piece, Square from, Square to)
+    {
+        const Bitboard from_to = Bitboard(from) | Bitboard(to);
+        squares[from] = Pieces::NO_PIECE;
+        squares[to] = piece;
+        pieces[color][piece.type()] ^= from_to;
+        land[color] ^= from_to;
+        cur_zobrist_hash ^= Zobrist::piece_square_keys[64 * int(piece) + from] ^
+                            Zobrist::piece_square_keys[64 * int(piece) + to];
+        if (piece.type() == PieceTypes::PAWN)
+            pawn_key ^= Zobrist::piece_square_keys[64 * int(piece) + from] ^
+                        Zobrist::piece_square_keys[64 * int(piece) + to];
+        else
+            non_pawn_keys[color] ^= Zobrist::piece_square_keys[64 * int(piece) + from] ^
+                                    Zobrist::piece_square_keys[64 * int(piece) + to];
+        auto &accumulator = accumulators.back();
+        accumulator[0].move_feature(feature_index(piece, from, Colors::BLACK), feature_index(piece, to, Colors::BLACK));
+        accumulator[1].move_feature(feature_index(piece, from, Colors::WHITE), feature_index(piece, to, Colors::WHITE));
+    }
+
     std::vector<std::array<NNUE::NNUENetwork::Accumulator, 2>> accumulators;
+    std::vector<Position> position_stack; // only used in copy-make mode
 
     struct BoardState
     {
@@ -844,14 +980,21 @@ class Board
         uint8_t castling;
         Square en_passant;
         uint64_t zobrist_hash;
-        Bitboard checkers, pinned_pieces;
-        constexpr BoardState(Piece captured, uint8_t castling, Square en_passant, uint64_t zobrist_hash)
-            : captured(captured), castling(castling), en_passant(en_passant), zobrist_hash(zobrist_hash)
+        uint64_t pawn_key, material_key;
+        std::array<uint64_t, 2> non_pawn_keys;
+        // lazily filled, see checkers() and pinned_pieces()
+        mutable Bitboard checkers, pinned_pieces;
+        mutable bool has_checkers = false, has_pinned_pieces = false;
+        constexpr BoardState(Piece captured, uint8_t castling, Square en_passant, uint64_t zobrist_hash,
+                             uint64_t pawn_key, uint64_t material_key, std::array<uint64_t, 2> non_pawn_keys)
+            : captured(captured), castling(castling), en_passant(en_passant), zobrist_hash(zobrist_hash),
+              pawn_key(pawn_key), material_key(material_key), non_pawn_keys(non_pawn_keys)
         {
         }
     };
 
     std::vector<BoardState> board_state_array;
+    std::vector<uint64_t> hash_history; // one hash per ply, dense for repetition checks
 
     std::vector<int> half_moves;
     uint8_t full_moves = 0;
@@ -0,0 +1,231 @@
+#include "cluster.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace BBD::Engine
+{
+
+namespace
+{
+
+static_assert(sizeof(ClusterMessage) + CLUSTER_BATCH_SIZE * sizeof(TTEntry) <= CLUSTER_MAX_MESSAGE_SIZE);
+
+bool make_address(const std::string &path, sockaddr_un &address)
+{
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+void merge_batch(TranspositionTable &tt, const char *payload, size_t size, uint64_t &received_entries)
+{
+    for (size_t offset = 0; offset + sizeof(TTEntry) <= size; offset += sizeof(TTEntry))
+    {
+        TTEntry entry;
+        std::memcpy(&entry, payload + offset, sizeof(TTEntry));
+        tt.merge(entry);
+        received_entries++;
+    }
+}
+
+} // namespace
+
+ClusterNode::~ClusterNode()
+{
+    for (int fd : peers)
+        close(fd);
+    if (listen_fd >= 0)
+        close(listen_fd);
+}
+
+bool ClusterNode::listen(const std::string &path)
+{
+    sockaddr_un address;
+    if (!make_address(path, address))
+        return false;
+
+    // the helpers of the previous socket are not part of the new cluster
+    for (int fd : peers)
+        close(fd);
+    peers.clear();
+    if (listen_fd >= 0)
+        close(listen_fd);
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0)
+        return false;
+
+    unlink(path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listen_fd, 64) < 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool ClusterNode::connect(const std::string &path)
+{
+    sockaddr_un address;
+    if (!make_address(path, address))
+        return false;
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0)
+        return false;
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    add_peer(fd);
+    return true;
+}
+
+void ClusterNode::add_peer(int fd)
+{
+    peers.push_back(fd);
+}
+
+void ClusterNode::accept_peers()
+{
+    if (listen_fd < 0)
+        return;
+
+    int fd;
+    while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0)
+        add_peer(fd);
+}
+
+bool ClusterNode::send_message(int fd, ClusterMessage type, const void *payload, size_t size, bool blocking)
+{
+    std::vector<char> message(sizeof(type) + size);
+    std::memcpy(message.data(), &type, sizeof(type));
+    if (size)
+        std::memcpy(message.data() + sizeof(type), payload, size);
+
+    // a full socket buffer drops a TT batch rather than stalling the search
+    const int flags = MSG_NOSIGNAL | (blocking ? 0 : MSG_DONTWAIT);
+    return send(fd, message.data(), message.size(), flags) == static_cast<ssize_t>(message.size());
+}
+
+void ClusterNode::flush()
+{
+    if (outgoing.empty())
+        return;
+    for (int fd : peers)
+        send_message(fd, ClusterMessage::TT_BATCH, outgoing.data(), outgoing.size() * sizeof(TTEntry), false);
+    outgoing.clear();
+}
+
+bool ClusterNode::start_search(const std::string &position_command)
+{
+    // with room for the rank, a cut off command would be a different position
+    if (sizeof(ClusterMessage) + 32 + position_command.size() > CLUSTER_MAX_MESSAGE_SIZE)
+        return false;
+
+    for (size_t i = 0; i < peers.size(); i++)
+    {
+        const std::string payload = std::to_string(i + 1) + " " + position_command;
+        send_message(peers[i], ClusterMessage::SEARCH, payload.data(), payload.size(), true);
+    }
+    return true;
+}
+
+void ClusterNode::stop_peers()
+{
+    flush();
+    for (int fd : peers)
+        send_message(fd, ClusterMessage::STOP, nullptr, 0, true);
+}
+
+void ClusterNode::share(const TTEntry &entry)
+{
+    outgoing.push_back(entry);
+    if (outgoing.size() >= CLUSTER_BATCH_SIZE)
+        flush();
+}
+
+bool ClusterNode::poll(TranspositionTable &tt)
+{
+    bool stop = false;
+
+    for (size_t i = 0; i < peers.size();)
+    {
+        // MSG_TRUNC gives the real length, so a message that didn't fit is dropped instead of parsed
+        const ssize_t size = recv(peers[i], buffer.data(), buffer.size(), MSG_DONTWAIT | MSG_TRUNC);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            i++;
+            continue;
+        }
+        if (size > static_cast<ssize_t>(buffer.size()))
+            continue;
+        if (size < static_cast<ssize_t>(sizeof(ClusterMessage)))
+        {
+            // the peer went away, a helper has nothing left to search for
+            close(peers[i]);
+            peers.erase(peers.begin() + i);
+            stop |= listen_fd < 0;
+            continue;
+        }
+
+        ClusterMessage type;
+        std::memcpy(&type, buffer.data(), sizeof(type));
+        if (type == ClusterMessage::TT_BATCH)
+            merge_batch(tt, buffer.data() + sizeof(type), size - sizeof(type), received_entries);
+        else if (type == ClusterMessage::STOP)
+        {
+            // the pending entries belong to the search that just ended
+            outgoing.clear();
+            return true; // a SEARCH queued behind the stop is left for wait_for_search
+        }
+    }
+    return stop;
+}
+
+bool ClusterNode::wait_for_search(TranspositionTable &tt, int &rank, std::string &position_command)
+{
+    while (!peers.empty())
+    {
+        const ssize_t size = recv(peers[0], buffer.data(), buffer.size(), MSG_TRUNC);
+        if (size > static_cast<ssize_t>(buffer.size()))
+            continue; // cut off, dropped
+        if (size < static_cast<ssize_t>(sizeof(ClusterMessage)))
+            break;
+
+        ClusterMessage type;
+        std::memcpy(&type, buffer.data(), sizeof(type));
+        const char *payload = buffer.data() + sizeof(type);
+        const size_t payload_size = size - sizeof(type);
+
+        if (type == ClusterMessage::TT_BATCH)
+        {
+            merge_batch(tt, payload, payload_size, received_entries);
+        }
+        else if (type == ClusterMessage::SEARCH)
+        {
+            const std::string text(payload, payload_size);
+            const size_t space = text.find(' ');
+            rank = std::atoi(text.substr(0, space).c_str());
+            position_command = space == std::string::npos ? "" : text.substr(space + 1);
+            return true;
+        }
+        // a stop that arrives between two searches has nothing to stop
+    }
+
+    for (int fd : peers)
+        close(fd);
+    peers.clear();
+    return false;
+}
+
+} // namespace BBD::Engine
@@ -0,0 +1,101 @@
+#pragma once
+#include "tt.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cluster search: several bbd processes on one host search the same position, Lazy SMP style. They are connected
+// by Unix sequenced packet sockets, so every message arrives whole. The main process sends the position and a
+// rank to each helper, the helpers start their search from a different root move and everyone shares its deep
+// TT entries in batches.
+namespace BBD::Engine
+{
+
+// only entries searched at least this deep are worth the traffic
+constexpr int CLUSTER_SHARE_DEPTH = 6;
+constexpr size_t CLUSTER_BATCH_SIZE = 64;
+
+// longest message, including the type, a longer position command is not sent
+constexpr size_t CLUSTER_MAX_MESSAGE_SIZE = 1 << 16;
+
+// Every message starts with its type, followed by the payload
+enum class ClusterMessage : uint32_t
+{
+    SEARCH,  // rank of the helper and the UCI position command, as text
+    STOP,    // no payload
+    TT_BATCH // array of TT entries
+};
+
+class ClusterNode
+{
+  private:
+    int listen_fd = -1;
+    std::vector<int> peers;
+    std::vector<TTEntry> outgoing;
+    std::vector<char> buffer = std::vector<char>(CLUSTER_MAX_MESSAGE_SIZE);
+    uint64_t received_entries = 0;
+
+    bool send_message(int fd, ClusterMessage type, const void *payload, size_t size, bool blocking);
+    void flush();
+
+  public:
+    ClusterNode() = default;
+    ClusterNode(const ClusterNode &) = delete;
+    ClusterNode &operator=(const ClusterNode &) = delete;
+    ~ClusterNode();
+
+    /// Opens the socket the helpers connect to, as the main process, closing the previous one and its helpers
+    /// \param path file system path of the socket, replaced if it exists
+    /// \return whether the socket could be opened
+    bool listen(const std::string &path);
+
+    /// Connects to the main process, as a helper
+    /// \param path file system path of the socket of the main process
+    /// \return whether the connection succeeded
+    bool connect(const std::string &path);
+
+    /// Adds an already connected socket as a peer, the node takes ownership of it
+    /// \param fd sequenced packet socket
+    void add_peer(int fd);
+
+    /// Accepts the helpers waiting on the listening socket, without blocking
+    void accept_peers();
+
+    /// \return number of connected peers
+    size_t peer_count() const
+    {
+        return peers.size();
+    }
+
+    /// \return number of TT entries received from the peers so far
+    uint64_t get_received_entries() const
+    {
+        return received_entries;
+    }
+
+    /// Sends every helper the position to search and its rank, starting from 1
+    /// \param position_command UCI position command
+    /// \return false if the command is too long for a message, nothing is sent then
+    bool start_search(const std::string &position_command);
+
+    /// Tells the peers to stop searching, the pending TT entries are sent first
+    void stop_peers();
+
+    /// Queues a TT entry for the peers, it is sent with the next full batch
+    /// \param entry entry searched at least CLUSTER_SHARE_DEPTH deep
+    void share(const TTEntry &entry);
+
+    /// Merges the TT batches received so far into the table, without blocking
+    /// \param tt table of this process
+    /// \return whether a peer asked to stop or went away, the unsent entries are dropped on a stop
+    bool poll(TranspositionTable &tt);
+
+    /// Waits for the next search request of the main process, merging TT batches on the way, as a helper
+    /// \param tt table of this process
+    /// \param rank set to the rank of this helper
+    /// \param position_command set to the UCI position command to search
+    /// \return false once the main process is gone
+    bool wait_for_search(TranspositionTable &tt, int &rank, std::string &position_command);
+};
+
+} // namespace BBD::Engine
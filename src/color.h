@@ -5,23 +5,22 @@ namespace BBD
 
 class Color
 {
-  private:
-    bool m_color;
-
   public:
+    bool m_color; // public so that Color can be used as a template parameter
+
     constexpr Color() = default;
     constexpr Color(bool color) : m_color(color)
     {
     }
 
-    operator bool() const
+    constexpr operator bool() const
     {
         return m_color;
     }
 
     /// flips the color
     /// \return
-    const Color flip() const
+    constexpr const Color flip() const
     {
         return Color(!m_color);
     }
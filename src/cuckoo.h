@@ -0,0 +1,74 @@
+#pragma once
+#include "attacks.h"
+#include "move.h"
+#include "piece.h"
+#include "square.h"
+#include "zobrist.h"
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+/*
+Cuckoo tables used to detect that the side to move can repeat a position with its next move.
+For every reversible move of a non-pawn piece between two squares, the table stores the
+hash difference that move makes, so a single lookup tells whether two positions in the
+history are one reversible move apart. More here:
+https://web.archive.org/web/20201107002606/https://marcelk.net/2013-04-06/paper/upcoming-rep-v2.pdf
+*/
+
+namespace BBD::Cuckoo
+{
+
+constexpr size_t TABLE_SIZE = 1 << 13;
+
+inline std::array<uint64_t, TABLE_SIZE> keys;
+inline std::array<Move, TABLE_SIZE> moves;
+
+inline size_t h1(uint64_t key)
+{
+    return key & (TABLE_SIZE - 1);
+}
+
+inline size_t h2(uint64_t key)
+{
+    return (key >> 16) & (TABLE_SIZE - 1);
+}
+
+// needs attacks::init() and Zobrist::init() to be called before
+inline void init()
+{
+    keys.fill(0);
+    moves.fill(NULL_MOVE);
+
+    [[maybe_unused]] int count = 0;
+    for (int piece = Pieces::BLACK_KNIGHT; piece <= Pieces::WHITE_KING; piece++)
+    {
+        for (int from = Squares::A1; from <= Squares::H8; from++)
+        {
+            for (int to = from + 1; to <= Squares::H8; to++)
+            {
+                if (!attacks::generate_attacks(Piece(piece).type(), from, 0ull).has_square(to))
+                    continue;
+
+                Move move(from, to, MoveTypes::NO_TYPE);
+                uint64_t key = Zobrist::piece_square_keys[64 * piece + from] ^
+                               Zobrist::piece_square_keys[64 * piece + to] ^ Zobrist::black_to_move;
+
+                // standard cuckoo insertion, kick out the previous occupant until an empty slot is found
+                size_t index = h1(key);
+                while (true)
+                {
+                    std::swap(keys[index], key);
+                    std::swap(moves[index], move);
+                    if (move == NULL_MOVE)
+                        break;
+                    index = index == h1(key) ? h2(key) : h1(key);
+                }
+                count++;
+            }
+        }
+    }
+    assert(count == 3668);
+}
+
+}; // namespace BBD::Cuckoo
@@ -14,6 +14,13 @@ int main(int argc, char *argv[])
 {
     BBD::Engine::init();
 
+    // helper process of a cluster search, connected to the main process by the given socket
+    if (argc == 3 && !strcmp(argv[1], "helper"))
+    {
+        UCI::cluster_helper(argv[2]);
+        return 0;
+    }
+
     // benching for OpenBench
     if (argc == 2)
     {
@@ -82,6 +89,7 @@ int main(int argc, char *argv[])
             {
                 Board board(fen);
                 std::cout << fen << "\n";
+                thread.new_game();
                 thread.search(board, limiter);
 
                 total_nodes += thread.get_nodes();
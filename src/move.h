@@ -29,6 +29,19 @@ enum MovegenTypes
     ALL_MOVES
 };
 
+/*
+Categories of moves that get their own specialised make/undo code in the Board.
+Promotions may or may not capture, the other categories are exact.
+*/
+enum MoveCategories
+{
+    QUIET = 0,
+    CAPTURE,
+    CASTLING,
+    EN_PASSANT,
+    PROMOTION
+};
+
 /*
 We can encode a move by the from square, the to square and the type of the move.
 This way, all the moves are unique. The encoding is simple:
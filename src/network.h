@@ -77,6 +77,15 @@ class NNUENetwork
                 values[i] -= NNUENetwork::weights1[index][i];
             }
         }
+
+        // remove + add in a single pass, for a piece changing squares
+        void move_feature(int from_index, int to_index)
+        {
+            for (int i = 0; i < HIDDEN_SIZE; ++i)
+            {
+                values[i] += NNUENetwork::weights1[to_index][i] - NNUENetwork::weights1[from_index][i];
+            }
+        }
     };
 
     static int evaluate(const std::array<Accumulator, 2> &acc, bool perspective)
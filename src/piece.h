@@ -1,6 +1,7 @@
 #pragma once
 #include "color.h"
 #include <array>
+#include <cctype>
 #include <cstdint>
 
 namespace BBD
@@ -1,7 +1,9 @@
 #include "search.h"
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
 namespace BBD::Engine
 {
@@ -28,9 +30,155 @@ inline void print_board(const Board &board)
     std::cout << "\n   a b c d e f g h\n\n";
 }
 
+// Score in UCI form, mate scores are given in moves, negative when we get mated
+inline std::string uci_score(Score score)
+{
+    if (score >= MATE)
+        return "mate " + std::to_string((INF - score + 1) / 2);
+    if (score <= -MATE)
+        return "mate " + std::to_string(-(INF + score) / 2);
+    return "cp " + std::to_string(score);
+}
+
+// History gravity: the closer an entry is to the bounds the smaller the update, so it never leaves them
+inline void update_history(int &entry, int bonus)
+{
+    entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+inline int history_bonus(int depth)
+{
+    return std::min(32 * depth * depth, HISTORY_MAX / 8);
+}
+
+PieceToHistory *SearchThread::continuation(int ply, int plies_back)
+{
+    if (ply < plies_back || !stack_moves[ply - plies_back])
+        return nullptr;
+    return &continuation_history[64 * int(stack_pieces[ply - plies_back]) + stack_moves[ply - plies_back].to()];
+}
+
+int SearchThread::quiet_history(Move move, Piece piece, int ply)
+{
+    int score = history[board.player_color()][move.from()][move.to()];
+    for (int plies_back : {1, 2})
+    {
+        if (PieceToHistory *cont = continuation(ply, plies_back))
+            score += (*cont)[int(piece)][move.to()];
+    }
+    return score;
+}
+
+void SearchThread::update_quiet_history(Move move, Piece piece, int ply, int bonus)
+{
+    update_history(history[board.player_color()][move.from()][move.to()], bonus);
+    for (int plies_back : {1, 2})
+    {
+        if (PieceToHistory *cont = continuation(ply, plies_back))
+            update_history((*cont)[int(piece)][move.to()], bonus);
+    }
+}
+
+int &SearchThread::capture_history_entry(Move move)
+{
+    // en passant and promotions without a capture are filed under pawn captures
+    const Piece captured = board.at(move.to());
+    const PieceType captured_type = captured != Pieces::NO_PIECE ? captured.type() : PieceTypes::PAWN;
+    return capture_history[int(board.at(move.from()))][move.to()][captured_type];
+}
+
+Move SearchThread::pv_move(int ply)
+{
+    if (ply >= prev_pv_length)
+        return NULL_MOVE;
+    for (int i = 0; i < ply; i++)
+    {
+        if (stack_moves[i] != prev_pv[i])
+            return NULL_MOVE;
+    }
+    return prev_pv[ply];
+}
+
+void SearchThread::check_limits()
+{
+    if (cluster && nodes % 1024 == 0 && cluster->poll(tt))
+        stopped = true;
+    if (stopped)
+        throw "Stopped";
+
+    const bool ponder = pondering;
+    if (was_pondering && !ponder)
+    {
+        // Ponderhit: the time spent pondering counts as our own thinking time, up to half of the move time,
+        // so we answer sooner and keep the rest on our clock
+        const time_t now = get_time_since_start();
+        start_time = now - std::min<time_t>(now - start_time, limiter.get_move_time() / 2);
+        was_pondering = false;
+    }
+
+    if (limiter.get_mode() == SearchLimiter::SearchMode::TIME_SEARCH && !ponder)
+    {
+        if (nodes && nodes % (1 << 12))
+        {
+            if (get_time_since_start() - start_time > limiter.get_move_time())
+                throw "Timeout";
+        }
+    }
+}
+
+Move SearchThread::ponder_move()
+{
+    if (root_moves.empty() || root_moves[0].move != thread_best_move)
+        return NULL_MOVE;
+    if (root_moves[0].pv_length > 1)
+        return root_moves[0].pv[1];
+
+    board.make_move(thread_best_move);
+    Move tt_move = NULL_MOVE, reply = NULL_MOVE;
+    Score tt_score, tt_eval;
+    TTBound tt_bound;
+    if (tt.probe(board.get_cur_hash(), 0, tt_score, tt_bound, tt_move, tt_eval) && tt_move)
+    {
+        // the TT move may come from a key collision, so only a legal move is trusted
+        MoveList moves;
+        int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
+        for (int i = 0; i < nr_moves; i++)
+        {
+            if (moves[i] == tt_move && board.is_legal(tt_move))
+                reply = tt_move;
+        }
+    }
+    board.undo_move(thread_best_move);
+    return reply;
+}
+
+Score SearchThread::corrected_eval(Score raw_eval)
+{
+    const int color = board.player_color();
+    const int correction = pawn_correction[color][board.get_pawn_key() % CORRECTION_SIZE] +
+                           material_correction[color][board.get_material_key() % CORRECTION_SIZE];
+    return std::clamp(raw_eval + correction / (2 * CORRECTION_GRAIN), -MATE + 1, MATE - 1);
+}
+
+void SearchThread::update_correction(int depth, Score raw_eval, Score score)
+{
+    // moving average of the scaled error, deeper searches get a bigger weight
+    const int error = (score - raw_eval) * CORRECTION_GRAIN;
+    const int weight = std::min(depth + 1, 16);
+    const int color = board.player_color();
+    for (int *entry : {&pawn_correction[color][board.get_pawn_key() % CORRECTION_SIZE],
+                       &material_correction[color][board.get_material_key() % CORRECTION_SIZE]})
+    {
+        *entry = (*entry * (256 - weight) + error * weight) / 256;
+        *entry = std::clamp(*entry, -CORRECTION_MAX, CORRECTION_MAX);
+    }
+}
+
 void SearchThread::order_moves(MoveList &moves, int nr_moves, const Move tt_move, int ply)
 {
     std::array<int, 256> scores;
+    const Move counter_move =
+        ply > 0 && stack_moves[ply - 1] ? counter_moves[int(stack_pieces[ply - 1])][stack_moves[ply - 1].to()] : NULL_MOVE;
 
     // Try to rank captures higher
     for (int i = 0; i < nr_moves; i++)
@@ -44,7 +192,11 @@ void SearchThread::order_moves(MoveList &moves, int nr_moves, const Move tt_move
         }
         else if (board.is_capture(move))
         {
-            scores[i] = 900000000 + 100000 * int(board.at(move.to()));
+            // captures that lose material go after the quiet moves, then most valuable victim and capture history
+            const Piece captured = board.at(move.to());
+            scores[i] = (board.see(move, 0) ? 900000000 : -900000000) +
+                        16 * see_values[captured != Pieces::NO_PIECE ? captured.type() : PieceTypes::PAWN] +
+                        capture_history_entry(move);
         }
         else if (move == killers[ply][0])
         {
@@ -54,9 +206,13 @@ void SearchThread::order_moves(MoveList &moves, int nr_moves, const Move tt_move
         {
             scores[i] = 700000000;
         }
+        else if (move == counter_move)
+        {
+            scores[i] = 600000000;
+        }
         else
         {
-            scores[i] = history[board.player_color()][move.from()][move.to()];
+            scores[i] = quiet_history(move, board.at(move.from()), ply);
         }
     }
 
@@ -76,10 +232,18 @@ void SearchThread::order_moves(MoveList &moves, int nr_moves, const Move tt_move
 
 Score SearchThread::quiescence(Score alpha, Score beta, int ply)
 {
-    if (board.threefold_check())
+    pv_length[ply] = ply; // quiescence lines are not part of the PV
+
+    if (board.is_repetition(ply) || board.is_insufficient_material() || board.is_fifty_move_draw())
     {
         return 0; // draw
     }
+    if (alpha < 0 && board.has_upcoming_repetition(ply))
+    {
+        alpha = 0; // we can force a draw
+        if (alpha >= beta)
+            return alpha;
+    }
 
     if (ply == MAX_DEPTH)
     { // don't pass the maximum depth, might crash
@@ -87,28 +251,57 @@ Score SearchThread::quiescence(Score alpha, Score beta, int ply)
     }
 
     nodes++;
+    seldepth = std::max(seldepth, ply);
+
+    check_limits();
 
-    if (limiter.get_mode() == SearchLimiter::SearchMode::TIME_SEARCH)
+    // Transposition table probe, any stored depth is enough for a quiescence search
+    const uint64_t pos_key = board.get_cur_hash();
+    Move tt_move = NULL_MOVE;
+    Score tt_score = 0;
+    TTBound tt_bound = TTBound::UPPER;
+    Score tt_eval = -INF;
+    const bool tt_hit = tt.probe(pos_key, 0, tt_score, tt_bound, tt_move, tt_eval);
+    tt_score = score_from_tt(tt_score, ply);
+
+    if (tt_hit && (tt_bound == TTBound::EXACT || (tt_bound == TTBound::LOWER && tt_score >= beta) ||
+                   (tt_bound == TTBound::UPPER && tt_score <= alpha)))
+        return tt_score;
+
+    const Score alpha_original = alpha;
+    const bool in_check = board.checkers();
+    Score raw_eval = -INF, eval = -INF, best = -INF;
+    Move best_move = NULL_MOVE;
+
+    // Stand pat, not allowed in check since we have to get out of it
+    if (!in_check)
     {
-        if (nodes && nodes % (1 << 12))
+        raw_eval = tt_eval != -INF ? tt_eval : NNUE::NNUENetwork::evaluate(board.get_accumulators(), board.player_color());
+        eval = raw_eval;
+
+        // the search score in the TT is a better estimate than the static eval when its bound allows it
+        if (tt_hit && (tt_bound == TTBound::EXACT || (tt_bound == TTBound::LOWER && tt_score > eval) ||
+                       (tt_bound == TTBound::UPPER && tt_score < eval)))
+            eval = tt_score;
+
+        best = eval;
+        if (best >= beta)
         {
-            if (get_time_since_start() - start_time > limiter.get_move_time())
-                throw "Timeout";
+            if (!tt_hit)
+                tt.store(pos_key, 0, score_to_tt(best, ply), TTBound::LOWER, NULL_MOVE, raw_eval);
+            return best;
         }
+        alpha = std::max(alpha, best);
     }
 
-    Score eval = NNUE::NNUENetwork::evaluate(board.get_accumulators(), board.player_color());
-    Score best = eval;
-
-    if (best >= beta)
-        return best;
-    alpha = std::max(alpha, best);
-
+    // in check all evasions are searched, otherwise only captures
     MoveList moves;
-    int nr_moves = board.gen_legal_moves<CAPTURE_MOVES>(moves);
+    int nr_moves =
+        in_check ? board.gen_legal_moves<ALL_MOVES>(moves) : board.gen_legal_moves<CAPTURE_MOVES>(moves);
 
-    order_moves(moves, nr_moves, NULL_MOVE, ply);
+    order_moves(moves, nr_moves, tt_move, ply);
 
+    int played = 0;
     for (int i = 0; i < nr_moves; i++)
     {
         Move move = moves[i];
@@ -116,15 +309,34 @@ Score SearchThread::quiescence(Score alpha, Score beta, int ply)
         if (!board.is_legal(move))
             continue;
 
-        assert(board.is_capture(move));
+        const bool capture = board.is_capture(move);
+        assert(in_check || capture);
 
+        if (!in_check && played > 0)
+        {
+            // Delta pruning: even winning the captured piece with a margin doesn't get us to alpha
+            const Piece captured = board.at(move.to());
+            if (!move.is_promo() &&
+                eval + DELTA_MARGIN +
+                        see_values[captured != Pieces::NO_PIECE ? captured.type() : PieceTypes::PAWN] <=
+                    alpha)
+                continue;
+        }
+
+        // losing captures can't raise the stand pat score
+        if (!in_check && !board.see(move, 0))
+            continue;
+
+        stack_moves[ply] = move, stack_pieces[ply] = board.at(move.from()), stack_captures[ply] = capture;
         board.make_move(move);
+        played++;
         Score score = -quiescence(-beta, -alpha, ply + 1);
         board.undo_move(move);
 
         if (score > best)
         {
             best = score;
+            best_move = move;
             if (score > alpha)
             {
                 alpha = score;
@@ -133,69 +345,111 @@ Score SearchThread::quiescence(Score alpha, Score beta, int ply)
             }
         }
     }
+
+    // no evasion means checkmate
+    if (in_check && played == 0)
+        return -INF + ply;
+
+    TTBound bound_type;
+    if (best >= beta)
+        bound_type = TTBound::LOWER;
+    else if (best > alpha_original)
+        bound_type = TTBound::EXACT;
+    else
+        bound_type = TTBound::UPPER;
+
+    // in check no eval was computed, the one the TT already had is stored back instead of -INF
+    tt.store(pos_key, 0, score_to_tt(best, ply), bound_type, best_move, in_check ? tt_eval : raw_eval);
+
     return best;
 }
 
-template <bool root_node> Score SearchThread::negamax(Score alpha, Score beta, int depth, int ply)
+template <NodeType node_type>
+Score SearchThread::negamax(Score alpha, Score beta, int depth, int ply, bool cut_node, Move excluded)
 {
-    Score alpha_original = alpha;
-    Move best_move;
+    constexpr bool root_node = node_type == NodeType::ROOT;
+    constexpr bool pv_node = node_type != NodeType::NON_PV;
+    Move best_move = NULL_MOVE;
+    pv_length[ply] = ply;
 
-    if (!root_node && board.threefold_check())
+    if (!root_node && (board.is_repetition(ply) || board.is_insufficient_material() || board.is_fifty_move_draw()))
     {
         return 0; // draw
     }
-    if (depth == 0)
+    if (!root_node && alpha < 0 && board.has_upcoming_repetition(ply))
+    {
+        alpha = 0; // we can force a draw
+        if (alpha >= beta)
+            return alpha;
+    }
+    Score alpha_original = alpha;
+
+    if (depth == 0 || ply >= MAX_DEPTH - 1)
         return quiescence(alpha, beta, ply);
 
     nodes++;
+    seldepth = std::max(seldepth, ply);
 
-    if (limiter.get_mode() == SearchLimiter::SearchMode::TIME_SEARCH)
-    {
-        if (nodes && nodes % (1 << 12))
-        {
-            if (get_time_since_start() - start_time > limiter.get_move_time())
-                throw "Timeout";
-        }
-    }
+    check_limits();
 
-    // Transposition table probe
+    // Transposition table probe, a search with an excluded move only takes the move from it
     uint64_t pos_key = board.get_cur_hash();
     Move tt_move = NULL_MOVE;
-
+    Score tt_score = 0;
+    TTBound tt_bound = TTBound::UPPER;
+    Score tt_eval = -INF;
+    const bool tt_hit = tt.probe(pos_key, depth, tt_score, tt_bound, tt_move, tt_eval);
+    tt_score = score_from_tt(tt_score, ply);
+    const int tt_depth = tt_hit ? tt.entry_depth(pos_key) : -1;
+
+    // PV nodes are always searched, a cutoff there would cut the PV short at the hit
+    if (!pv_node && !excluded && tt_hit && tt_depth >= depth &&
+        (tt_bound == TTBound::EXACT || (tt_bound == TTBound::LOWER && tt_score >= beta) ||
+         (tt_bound == TTBound::UPPER && tt_score <= alpha)))
+        return tt_score;
+
+    // Internal iterative reduction: without a TT move the ordering is poor, so search shallower
+    // and let the next iteration find a TT move cheaply
+    if (!root_node && (pv_node || cut_node) && !excluded && !tt_move && depth >= IIR_DEPTH)
+        depth--;
+
+    // Static eval, reused from the TT when possible. Without a hit it goes into the TT right away,
+    // so the searches below and later iterations can reuse it too
+    Score raw_eval = tt_eval;
+    if (raw_eval == -INF)
     {
-        Score tt_score;
-        TTBound tt_bound;
+        raw_eval = NNUE::NNUENetwork::evaluate(board.get_accumulators(), board.player_color());
+        if (!tt_hit)
+            tt.store(pos_key, -1, 0, TTBound::NONE, NULL_MOVE, raw_eval);
+    }
 
-        if (tt.probe(pos_key, depth, tt_score, tt_bound, tt_move))
-        {
-            if (!root_node && tt.entry_depth(pos_key) >= depth)
-            {
-                if (tt_bound == TTBound::EXACT)
-                    return tt_score;
-                if (tt_bound == TTBound::LOWER && tt_score > alpha)
-                    alpha = tt_score;
-                else if (tt_bound == TTBound::UPPER && tt_score < beta)
-                    beta = tt_score;
+    // the pruning decisions below use the eval corrected by what earlier searches found
+    const bool in_check = board.checkers();
+    const Score eval = in_check ? raw_eval : corrected_eval(raw_eval);
 
-                if (alpha >= beta)
-                    return tt_score;
-            }
-        }
-    }
+    // improving: our eval went up since our previous move, so cutoffs are more likely
+    static_evals[ply] = in_check ? -INF : eval;
+    const bool improving = !in_check && ply >= 2 && static_evals[ply - 2] != -INF && eval > static_evals[ply - 2];
 
     // Reverse futility pruning
-    Score eval = NNUE::NNUENetwork::evaluate(board.get_accumulators(), board.player_color());
 
-    if (!root_node && !board.checkers() && depth <= 3)
+    if (!root_node && !in_check && !excluded && depth <= RFP_DEPTH)
     {
-        int margin = 200 * depth;
+        int margin = RFP_MARGIN * depth;
         if (eval >= beta + margin)
         {
             return eval;
         }
     }
 
+    // Razoring: far below alpha, only captures can save us, so check with quiescence
+    if (!pv_node && !in_check && !excluded && depth <= RAZOR_DEPTH && eval + RAZOR_MARGIN * depth < alpha)
+    {
+        Score score = quiescence(alpha - 1, alpha, ply);
+        if (score < alpha)
+            return score;
+    }
+
     // check for null-move
     {
         auto major_pieces = board.get_piece_bitboard(board.player_color(), PieceTypes::QUEEN) |
@@ -204,15 +458,72 @@ template <bool root_node> Score SearchThread::negamax(Score alpha, Score beta, i
         auto non_pawn_material = major_pieces | board.get_piece_bitboard(board.player_color(), PieceTypes::BISHOP) |
                                  board.get_piece_bitboard(board.player_color(), PieceTypes::KNIGHT);
 
-        const short R = 2;
-        if (depth > R && !board.checkers() && major_pieces && non_pawn_material)
+        if (!pv_node && !in_check && !excluded && depth >= NMP_DEPTH && eval >= beta && ply >= nmp_min_ply &&
+            major_pieces && non_pawn_material)
         {
+            // reduce more at higher depth and the further the eval is above beta
+            const int R = NMP_BASE + depth / NMP_DEPTH_DIVISOR + std::min((eval - beta) / NMP_EVAL_DIVISOR, 3);
+            const int null_depth = std::max(depth - 1 - R, 0);
+
+            stack_moves[ply] = NULL_MOVE;
             board.make_null_move();
-            Score score = -negamax<false>(-beta, 1 - beta, depth - 1 - R, ply + 1);
+            Score score = -negamax<NodeType::NON_PV>(-beta, 1 - beta, null_depth, ply + 1, !cut_node);
             board.undo_null_move();
 
             if (score >= beta)
-                return beta;
+            {
+                // a mate found after passing is not a proven mate
+                if (score >= MATE)
+                    score = beta;
+                if (depth < NMP_VERIFICATION_DEPTH || nmp_min_ply)
+                    return score;
+
+                // Verification search: at high depth check the cutoff with null moves disabled for a few plies,
+                // so zugzwang positions don't get cut
+                nmp_min_ply = ply + 3 * null_depth / 4;
+                const Score verification = negamax<NodeType::NON_PV>(beta - 1, beta, null_depth, ply, false);
+                nmp_min_ply = 0;
+
+                if (verification >= beta)
+                    return score;
+            }
+        }
+    }
+
+    // ProbCut: at cut nodes a good capture that beats beta by a margin in a reduced search
+    // very likely beats beta in the full search as well
+    const Score probcut_beta = beta + PROBCUT_MARGIN;
+    if (cut_node && !in_check && !excluded && depth >= PROBCUT_DEPTH && std::abs(beta) < MATE &&
+        !(tt_hit && tt_depth >= depth - 3 && tt_score < probcut_beta))
+    {
+        MoveList noisy_moves;
+        int nr_noisy_moves = board.gen_legal_moves<CAPTURE_MOVES>(noisy_moves);
+
+        order_moves(noisy_moves, nr_noisy_moves, tt_move, ply);
+
+        for (int i = 0; i < nr_noisy_moves; i++)
+        {
+            Move move = noisy_moves[i];
+            if (!board.is_legal(move) || !board.see(move, probcut_beta - eval))
+                continue;
+
+            stack_moves[ply] = move, stack_pieces[ply] = board.at(move.from()), stack_captures[ply] = true;
+            board.make_move(move);
+
+            // a quiescence search first filters out most captures cheaply
+            Score score = -quiescence(-probcut_beta, 1 - probcut_beta, ply + 1);
+            if (score >= probcut_beta)
+                score = -negamax<NodeType::NON_PV>(-probcut_beta, 1 - probcut_beta, depth - PROBCUT_REDUCTION, ply + 1,
+                                                   !cut_node);
+
+            board.undo_move(move);
+
+            if (score >= probcut_beta)
+            {
+                tt.store(pos_key, depth - PROBCUT_REDUCTION + 1, score_to_tt(score, ply), TTBound::LOWER, move,
+                         raw_eval);
+                return score;
+            }
         }
     }
 
@@ -220,36 +531,127 @@ template <bool root_node> Score SearchThread::negamax(Score alpha, Score beta, i
     MoveList moves;
     int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
 
-    order_moves(moves, nr_moves, tt_move, ply);
+    // when the TT lost the move of a PV node, the move of the previous iteration's PV goes first instead
+    order_moves(moves, nr_moves, tt_move || !pv_node ? tt_move : pv_move(ply), ply);
+
+    // cluster helpers start from a different root move each, so the processes fill the TT for different subtrees
+    if (root_node && cluster_rank && nr_moves > 1)
+        std::rotate(moves.begin(), moves.begin() + cluster_rank % nr_moves, moves.begin() + nr_moves);
 
     Score best = -INF;
-    int played = 0;
+    int played = 0, quiets_played = 0;
+    int captures_played = 0;
+    MoveList quiets, captures; // moves searched so far, they get a malus if another move cuts
+    const int lmp_count = (LMP_BASE + depth * depth) / (2 - improving);
 
     for (int i = 0; i < nr_moves; i++)
     {
         Move move = moves[i];
-        if (!board.is_legal(move))
+        if (move == excluded || !board.is_legal(move))
             continue;
+        if constexpr (root_node)
+        {
+            if (std::any_of(root_moves.begin(), root_moves.begin() + pv_index,
+                            [&](const RootMove &rm) { return rm.move == move; }))
+                continue;
+        }
+
+        const bool quiet = !board.is_capture(move);
 
+        // Shallow depth pruning, once we have a move that doesn't get us mated
+        if (!root_node && played > 0 && best > -MATE && !in_check)
+        {
+            // Late move pruning: quiet moves this late in the ordering rarely matter
+            if (quiet && depth <= LMP_DEPTH && quiets_played >= lmp_count)
+                continue;
+
+            // Futility pruning: a quiet move won't bring the eval up to alpha
+            if (quiet && depth <= FUTILITY_DEPTH && eval + FUTILITY_BASE + FUTILITY_MARGIN * depth <= alpha)
+                continue;
+
+            // SEE pruning: skip moves that lose too much material
+            if (depth <= SEE_DEPTH &&
+                !board.see(move, quiet ? -SEE_QUIET_MARGIN * depth * depth : -SEE_CAPTURE_MARGIN * depth))
+                continue;
+        }
+
+        const Piece piece = board.at(move.from());
+        const int move_history = quiet ? quiet_history(move, piece, ply) : 0;
+
+        // Extensions, capped by the total extension along the path
+        int extension = 0;
+        const bool can_extend = !root_node && path_extensions[ply] < root_depth;
+        if (can_extend && move == tt_move && !excluded && depth >= SE_DEPTH && tt_bound != TTBound::UPPER &&
+            tt_depth >= depth - 3 && std::abs(tt_score) < MATE)
+        {
+            // Singular extension: extend the TT move if all other moves fail low against a lowered beta
+            const Score singular_beta = tt_score - 2 * depth;
+            const Score score =
+                negamax<NodeType::NON_PV>(singular_beta - 1, singular_beta, (depth - 1) / 2, ply, cut_node, move);
+            if (score < singular_beta)
+                extension = 1;
+            else if (singular_beta >= beta)
+                return singular_beta; // multi-cut: more than one move beats beta
+        }
+        else if (can_extend && pv_node && !quiet && ply > 0 && stack_captures[ply - 1] &&
+                 move.to() == stack_moves[ply - 1].to())
+        {
+            // Recapture extension
+            extension = 1;
+        }
+
+        stack_moves[ply] = move, stack_pieces[ply] = piece, stack_captures[ply] = !quiet;
         board.make_move(move);
         played++;
 
-        Score score;
+        // Check extension
+        if (can_extend && !extension && board.checkers())
+            extension = 1;
+        path_extensions[ply + 1] = path_extensions[ply] + extension;
+        const int new_depth = depth - 1 + extension;
 
-        if (played > 1)
+        Score score = -INF;
+
+        // null window search first, except for the first move of a PV node
+        if (!pv_node || played > 1)
         {
-            score = -negamax<false>(-alpha - 1, -alpha, depth - 1, ply + 1);
+            // Late move reductions: quiet moves late in the ordering are searched shallower first
+            int reduction = 0;
+            if (depth >= 3 && played > 1 + pv_node && quiet)
+            {
+                reduction = lmr_table[depth][std::min(played, 255)];
+                reduction += !pv_node + cut_node - improving;
+                reduction -= in_check || board.checkers(); // evasions and checking moves
+                reduction -= move_history / HISTORY_MAX;
+                reduction = std::clamp(reduction, 0, new_depth - 1);
+            }
 
-            if (score > alpha && score < beta)
-                score = -negamax<false>(-beta, -alpha, depth - 1, ply + 1);
+            if (reduction > 0)
+            {
+                score = -negamax<NodeType::NON_PV>(-alpha - 1, -alpha, new_depth - reduction, ply + 1, true);
+                if (score > alpha)
+                    score = -negamax<NodeType::NON_PV>(-alpha - 1, -alpha, new_depth, ply + 1, !cut_node);
+            }
+            else
+            {
+                score = -negamax<NodeType::NON_PV>(-alpha - 1, -alpha, new_depth, ply + 1, !cut_node);
+            }
         }
-        else
+
+        // full window search for the first move and for moves that landed inside the window
+        if constexpr (pv_node)
         {
-            score = -negamax<false>(-beta, -alpha, depth - 1, ply + 1);
+            if (played == 1 || (score > alpha && score < beta))
+                score = -negamax<NodeType::PV>(-beta, -alpha, new_depth, ply + 1, false);
         }
 
         board.undo_move(move);
 
+        if (quiet)
+            quiets[quiets_played++] = move;
+        else
+            captures[captures_played++] = move;
+
         if (score > best)
         {
             best = score;
@@ -261,25 +663,55 @@ template <bool root_node> Score SearchThread::negamax(Score alpha, Score beta, i
                 {
                     root_best_move = move;
                 }
+                if constexpr (pv_node)
+                {
+                    // the PV of this node is the move followed by the PV of the child
+                    pv_table[ply][ply] = move;
+                    for (int j = ply + 1; j < pv_length[ply + 1]; j++)
+                        pv_table[ply][j] = pv_table[ply + 1][j];
+                    pv_length[ply] = std::max(pv_length[ply + 1], ply + 1);
+                }
                 alpha = score;
 
                 if (alpha >= beta)
                 {
-                    if (move != killers[ply][0] && move != killers[ply][1] && !board.is_capture(move))
+                    const int bonus = history_bonus(depth);
+                    if (quiet)
+                    {
+                        if (move != killers[ply][0] && move != killers[ply][1])
+                        {
+                            killers[ply][1] = killers[ply][0];
+                            killers[ply][0] = move;
+                        }
+                        if (ply > 0 && stack_moves[ply - 1])
+                            counter_moves[int(stack_pieces[ply - 1])][stack_moves[ply - 1].to()] = move;
+
+                        // reward the cutoff move, punish the quiets that were searched before it
+                        for (int j = 0; j < quiets_played - 1; j++)
+                            update_quiet_history(quiets[j], board.at(quiets[j].from()), ply, -bonus);
+                        update_quiet_history(move, piece, ply, bonus);
+                    }
+                    else
                     {
-                        killers[ply][1] = killers[ply][0];
-                        killers[ply][0] = move;
+                        update_history(capture_history_entry(move), bonus);
                     }
-                    history[board.player_color()][move.from()][move.to()] += depth * depth;
+
+                    // captures that were searched first and failed to cut get a malus either way
+                    for (int j = 0; j < captures_played - !quiet; j++)
+                        update_history(capture_history_entry(captures[j]), -bonus);
                     break;
                 }
             }
         }
     }
 
-    // Checkmate / stalemate detection
+    // Checkmate / stalemate detection, with an excluded move there may just be no other move
     if (played == 0)
-        return board.checkers() ? -INF + ply : 0;
+        return excluded ? alpha : board.checkers() ? -INF + ply : 0;
+
+    // don't overwrite the entry of the full search, the later MultiPV passes don't see the best root moves
+    if (excluded || (root_node && pv_index > 0))
+        return best;
 
     // Store in transposition table
     TTBound bound_type;
@@ -290,76 +722,190 @@ template <bool root_node> Score SearchThread::negamax(Score alpha, Score beta, i
     else
         bound_type = TTBound::EXACT;
 
-    tt.store(pos_key, depth, best, bound_type, best_move);
+    tt.store(pos_key, depth, score_to_tt(best, ply), bound_type, best_move, raw_eval);
+    if (cluster && depth >= CLUSTER_SHARE_DEPTH)
+        cluster->share(TTEntry{pos_key, depth, score_to_tt(best, ply), bound_type, best_move, raw_eval});
+
+    // Correction history learns from quiet positions where the score moved the eval in the direction the bound allows
+    if (!in_check && (!best_move || !board.is_capture(best_move)) && std::abs(best) < MATE &&
+        !(bound_type == TTBound::LOWER && best <= eval) && !(bound_type == TTBound::UPPER && best >= eval))
+        update_correction(depth, raw_eval, best);
 
     return best;
 }
 
-Move SearchThread::search(Board &_board, SearchLimiter &_limiter)
+void SearchThread::new_game()
 {
-    auto search_start_time = get_time_since_start();
-    nodes = 0;
-    board = _board, limiter = _limiter;
-
     tt.clear();
 
-    // Fill history with 0 at the beginning
+    // Fill history with 0
     for (auto &t : history)
     {
         for (auto &p : t)
             p.fill(0);
     }
+    for (auto &t : continuation_history)
+    {
+        for (auto &p : t)
+            p.fill(0);
+    }
+    for (auto &t : counter_moves)
+        t.fill(NULL_MOVE);
+    for (auto &t : capture_history)
+    {
+        for (auto &p : t)
+            p.fill(0);
+    }
+    for (auto &t : pawn_correction)
+        t.fill(0);
+    for (auto &t : material_correction)
+        t.fill(0);
+}
+
+Move SearchThread::search(Board &_board, SearchLimiter &_limiter)
+{
+    auto search_start_time = get_time_since_start();
+    nodes = 0;
+    board = _board, limiter = _limiter;
+    tt.new_search();
 
     for (int i = 0; i < MAX_DEPTH; i++)
     {
         killers[i].fill(NULL_MOVE);
     }
+    prev_pv_length = 0;
+
+    root_moves.clear();
+    {
+        MoveList moves;
+        int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
+        for (int i = 0; i < nr_moves; i++)
+        {
+            if (board.is_legal(moves[i]))
+                root_moves.push_back(RootMove{moves[i]});
+        }
+    }
+    thread_best_move = root_best_move = NULL_MOVE;
 
     int score, alpha, beta;
     auto depth = 1;
     auto running = true;
     int limit_depth = limiter.get_mode() == SearchLimiter::SearchMode::DEPTH_SEARCH ? limiter.get_depth() : 100;
 
+    auto print_line = [&](int line, int line_seldepth, Score line_score, const char *bound,
+                          std::array<Move, MAX_DEPTH + 1> &pv, int length) {
+        std::cout << "info multipv " << line << " depth " << depth << " seldepth " << line_seldepth << " score "
+                  << uci_score(line_score) << bound << " nodes " << nodes << " time "
+                  << get_time_since_start() - search_start_time;
+        if (length > 0)
+            std::cout << " pv";
+        for (int i = 0; i < length; i++)
+            std::cout << " " << pv[i].to_string();
+        std::cout << std::endl;
+    };
+
     start_clock();
+    was_pondering = pondering;
     while (running && depth <= limit_depth) // limit how much we can search
     {
-        int window = 30;
-        if (depth <= 4)
-        {
-            alpha = -INF;
-            beta = INF;
-        }
-        else
-        {
-            alpha = std::max<Score>(-INF, score - window);
-            beta = std::min<Score>(INF, score + window);
-        }
-
-        // aspiration windows loop
+        // MultiPV: every pass searches the root without the moves picked by the passes before it,
+        // the TT filled by the first pass makes the other ones cheap
+        const int passes = std::min<int>(multi_pv, root_moves.size());
         try
         {
-            while (true)
+            bool pass_failed = false;
+            for (pv_index = 0; pv_index < passes; pv_index++)
             {
-                score = negamax<true>(alpha, beta, depth, 0);
-                std::cout << "info score " << score << " depth " << depth << " nodes " << nodes << " time "
-                          << get_time_since_start() - search_start_time << std::endl;
-                std::cout << alpha << " " << beta << " " << window << "\n";
-                thread_best_move = root_best_move; // only take into account full search results, for now
+                RootMove &root_move = root_moves[pv_index];
+                score = root_move.score;
 
-                if (score <= alpha)
+                int window = 30;
+                if (depth <= 4)
                 {
-                    alpha = std::max<int>(-INF, alpha - window);
+                    alpha = -INF;
+                    beta = INF;
                 }
-                else if (score >= beta)
+                else
                 {
-                    beta = std::min<int>(INF, beta + window);
+                    alpha = std::max<Score>(-INF, score - window);
+                    beta = std::min<Score>(INF, score + window);
                 }
-                else
+
+                // follow the PV this pass found in the previous iteration
+                prev_pv = root_move.pv;
+                prev_pv_length = root_move.pv_length;
+
+                // aspiration windows loop
+                while (true)
                 {
-                    break;
+                    root_depth = depth;
+                    nmp_min_ply = 0;
+                    path_extensions[0] = 0;
+                    seldepth = 0;
+                    if (pv_index == 0)
+                        root_best_move = thread_best_move; // kept when the search fails low
+                    score = negamax<NodeType::ROOT>(alpha, beta, depth, 0, false);
+
+                    // with several lines, they are printed in order once all the passes of the iteration are done
+                    if (!quiet && passes == 1)
+                    {
+                        // nothing raised alpha at a fail-low root, the PV of the previous iteration is shown instead
+                        const bool has_pv = pv_length[0] > 0;
+                        const char *bound = score <= alpha ? " upperbound" : score >= beta ? " lowerbound" : "";
+                        print_line(1, seldepth, score, bound, has_pv ? pv_table[0] : root_move.pv,
+                                   has_pv ? pv_length[0] : root_move.pv_length);
+                    }
+                    if (pv_index == 0)
+                        thread_best_move = root_best_move; // only take into account full search results, for now
+
+                    if (score <= alpha)
+                    {
+                        alpha = std::max<int>(-INF, alpha - window);
+                    }
+                    else if (score >= beta)
+                    {
+                        beta = std::min<int>(INF, beta + window);
+                    }
+                    else
+                    {
+                        // the best move of the pass takes its place among the picked moves with its score and PV,
+                        // a PV cut short by the window is not trusted
+                        auto picked = root_moves.end();
+                        if (pv_length[0] > 0)
+                            picked = std::find_if(root_moves.begin() + pv_index, root_moves.end(),
+                                                  [&](const RootMove &rm) { return rm.move == pv_table[0][0]; });
+                        if (picked == root_moves.end())
+                        {
+                            // no move left to pick, the later passes of this iteration would exclude the wrong moves
+                            pass_failed = true;
+                            break;
+                        }
+                        std::iter_swap(root_moves.begin() + pv_index, picked);
+                        root_move.score = score;
+                        root_move.pv = pv_table[0];
+                        root_move.pv_length = pv_length[0];
+                        root_move.seldepth = seldepth;
+                        break;
+                    }
+
+                    window = std::min<int>(INF, 2 * window);
                 }
+                if (pass_failed)
+                    break;
+            }
 
-                window = std::min<int>(INF, 2 * window);
+            // the passes don't always agree on the order of their scores, so the picked moves are sorted and the
+            // best of them is played
+            const int picked = pv_index;
+            std::stable_sort(root_moves.begin(), root_moves.begin() + picked,
+                             [](const RootMove &a, const RootMove &b) { return a.score > b.score; });
+            if (picked > 0)
+                thread_best_move = root_moves[0].move;
+            if (!quiet && passes > 1)
+            {
+                for (int i = 0; i < picked; i++)
+                    print_line(i + 1, root_moves[i].seldepth, root_moves[i].score, "", root_moves[i].pv,
+                               root_moves[i].pv_length);
             }
         }
         catch (...)
@@ -369,7 +915,19 @@ Move SearchThread::search(Board &_board, SearchLimiter &_limiter)
 
         depth++;
     }
-    std::cout << "bestmove " << thread_best_move.to_string() << std::endl;
+
+    // a pondering search may not answer before the ponderhit or stop, even once it is done
+    while (pondering && !stopped)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (!quiet)
+    {
+        board = _board; // a stopped search leaves the board somewhere in the tree
+        std::cout << "bestmove " << thread_best_move.to_string();
+        if (Move reply = ponder_move())
+            std::cout << " ponder " << reply.to_string();
+        std::cout << std::endl;
+    }
 
     return thread_best_move;
 }
@@ -1,14 +1,18 @@
 #pragma once
 
 #include "board.h"
+#include "cluster.h"
 #include "move.h"
 #include "tt.h"
 #include "util.h"
 #include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <ctime>
 
 #include <filesystem>
+#include <vector>
 
 // Setup for searching thread
 namespace BBD::Engine
@@ -16,10 +20,52 @@ namespace BBD::Engine
 
 constexpr int MAX_DEPTH = 100;
 
+// negamax is compiled separately for each node type, the root is a PV node as well
+enum class NodeType
+{
+    ROOT,
+    PV,
+    NON_PV
+};
+
+// Pruning margins and depth limits, in centipawns and plies
+constexpr int RFP_DEPTH = 3, RFP_MARGIN = 200;
+constexpr int RAZOR_DEPTH = 2, RAZOR_MARGIN = 250;
+constexpr int FUTILITY_DEPTH = 6, FUTILITY_BASE = 100, FUTILITY_MARGIN = 100;
+constexpr int LMP_DEPTH = 6, LMP_BASE = 3;
+constexpr int SEE_DEPTH = 6, SEE_CAPTURE_MARGIN = 100, SEE_QUIET_MARGIN = 40;
+constexpr int SE_DEPTH = 6;
+constexpr int IIR_DEPTH = 4;
+constexpr int NMP_DEPTH = 3, NMP_BASE = 3, NMP_DEPTH_DIVISOR = 3, NMP_EVAL_DIVISOR = 200;
+constexpr int NMP_VERIFICATION_DEPTH = 12;
+constexpr int PROBCUT_DEPTH = 5, PROBCUT_REDUCTION = 4, PROBCUT_MARGIN = 200;
+constexpr int DELTA_MARGIN = 200;
+
+// Correction history: entries hold the eval error in 1/CORRECTION_GRAIN centipawns
+constexpr int CORRECTION_SIZE = 1 << 14, CORRECTION_GRAIN = 256, CORRECTION_MAX = 64 * CORRECTION_GRAIN;
+
+// History scores are kept inside [-HISTORY_MAX, HISTORY_MAX] by the gravity update
+constexpr int HISTORY_MAX = 16384;
+
+// History of a move given by its piece and destination, used for continuation histories
+typedef std::array<std::array<int, 64>, 12> PieceToHistory;
+
+// Late move reductions, indexed by depth and number of moves played, grows with the log of both
+inline const std::array<std::array<int, 256>, MAX_DEPTH + 1> lmr_table = [] {
+    std::array<std::array<int, 256>, MAX_DEPTH + 1> table{};
+    for (int depth = 1; depth <= MAX_DEPTH; depth++)
+    {
+        for (int played = 1; played < 256; played++)
+            table[depth][played] = static_cast<int>(0.75 + std::log(depth) * std::log(played) / 2.25);
+    }
+    return table;
+}();
+
 inline void init(const std::string &weitghts_path = "./drill/nnue_v1-100/quantised.bin")
 {
     BBD::attacks::init();
     BBD::Zobrist::init();
+    BBD::Cuckoo::init();
     BBD::NNUE::NNUENetwork::load_from_file(weitghts_path);
 }
 
@@ -66,6 +112,15 @@ class SearchLimiter
     }
 };
 
+// A legal move of the root position, with the result of the last search that picked it in MultiPV mode
+struct RootMove
+{
+    Move move;
+    Score score = -INF;
+    std::array<Move, MAX_DEPTH + 1> pv;
+    int pv_length = 0, seldepth = 0;
+};
+
 class SearchThread
 {
   private:
@@ -74,22 +129,149 @@ class SearchThread
     SearchLimiter limiter;
     std::array<std::array<std::array<int, 64>, 64>, 2> history;
     std::array<std::array<Move, 2>, MAX_DEPTH> killers;
+    std::array<Score, MAX_DEPTH + 1> static_evals;
+
+    // moves on the current path and the pieces that made them, NULL_MOVE for null moves
+    std::array<Move, MAX_DEPTH + 1> stack_moves;
+    std::array<Piece, MAX_DEPTH + 1> stack_pieces;
+    std::array<bool, MAX_DEPTH + 1> stack_captures;
+
+    // plies of extension from the root to each node of the current path, capped by the root depth
+    std::array<int, MAX_DEPTH + 1> path_extensions;
+    int root_depth;
+
+    // null moves are disabled below this ply while verifying a null move cutoff
+    int nmp_min_ply;
+
+    // triangular PV table: pv_table[ply] holds the best line from ply, up to pv_length[ply]
+    std::array<std::array<Move, MAX_DEPTH + 1>, MAX_DEPTH + 1> pv_table;
+    std::array<int, MAX_DEPTH + 1> pv_length;
+
+    // PV of the last iteration that finished inside its window, searched first while the path follows it
+    std::array<Move, MAX_DEPTH + 1> prev_pv;
+    int prev_pv_length;
+
+    // MultiPV: the moves picked by the passes before pv_index come first and are skipped at the root
+    std::vector<RootMove> root_moves;
+    int multi_pv = 1, pv_index = 0;
+
+    // highest ply reached in the current iteration, quiescence included
+    int seldepth;
+
+    // indexed by the piece and destination of the previous move, shared by the 1 and 2 ply continuations
+    std::vector<PieceToHistory> continuation_history = std::vector<PieceToHistory>(12 * 64);
+    std::array<std::array<Move, 64>, 12> counter_moves;
+
+    // indexed by moving piece, destination and captured piece type
+    std::array<std::array<std::array<int, 6>, 64>, 12> capture_history;
+
+    // indexed by side to move and pawn or material key
+    std::array<std::array<int, CORRECTION_SIZE>, 2> pawn_correction, material_correction;
 
     TranspositionTable tt;
 
+    // other processes of a cluster search, a helper starts its root move list at its rank
+    ClusterNode *cluster = nullptr;
+    int cluster_rank = 0;
+
+    // no UCI output, for the helpers of a cluster search
+    bool quiet = false;
+
     time_t start_time;
 
+    // set from the UCI thread while a search runs, a pondering search has no time limit until ponderhit
+    std::atomic<bool> stopped = false, pondering = false;
+    bool was_pondering;
+
     uint64_t nodes;
 
+    // continuation history of the move played plies_back plies before ply, nullptr if there is none
+    PieceToHistory *continuation(int ply, int plies_back);
+
+    int quiet_history(Move move, Piece piece, int ply);
+    void update_quiet_history(Move move, Piece piece, int ply, int bonus);
+
+    int &capture_history_entry(Move move);
+
+    // move of the previous PV at ply if the current path still follows that PV, NULL_MOVE otherwise
+    Move pv_move(int ply);
+
+    // throws when the search has to stop, the ponder time is turned into a clock bonus on the first check after
+    // a ponderhit
+    void check_limits();
+
+    // second move of the PV, or the TT move of the position after the best move when the PV is too short
+    Move ponder_move();
+
+    Score corrected_eval(Score raw_eval);
+    void update_correction(int depth, Score raw_eval, Score score);
+
   public:
+    SearchThread()
+    {
+        new_game();
+    }
+
+    /// Forgets the TT and histories, which are otherwise carried over from one search to the next
+    void new_game();
+
+    /// Resets the stop request before a search is started on another thread
+    /// \param ponder whether the search starts pondering on the move expected from the opponent
+    void prepare(bool ponder)
+    {
+        stopped = false;
+        pondering = ponder;
+    }
+
+    /// Asks a running search to return its best move as soon as possible
+    void stop()
+    {
+        stopped = true;
+    }
+
+    /// The opponent played the expected move, the pondering search goes on under the usual time limit
+    void ponderhit()
+    {
+        pondering = false;
+    }
+
+    /// Shares deep TT entries with the other processes of a cluster search
+    /// \param node connection to the other processes, nullptr to search alone
+    /// \param rank 0 for the main process, 1 and up for the helpers
+    void set_cluster(ClusterNode *node, int rank)
+    {
+        cluster = node;
+        cluster_rank = rank;
+    }
+
+    /// Turns the info and bestmove output on or off, the best move is returned either way
+    /// \param _quiet true for no output
+    void set_quiet(bool _quiet)
+    {
+        quiet = _quiet;
+    }
+
+    TranspositionTable &get_tt()
+    {
+        return tt;
+    }
+
     void order_moves(MoveList &moves, int nr_moves, const Move tt_move, int ply);
 
     Score quiescence(Score alpha, Score beta, int ply);
 
-    template <bool root_node> Score negamax(Score alpha, Score beta, int depth, int ply);
+    template <NodeType node_type>
+    Score negamax(Score alpha, Score beta, int depth, int ply, bool cut_node, Move excluded = NULL_MOVE);
 
     Move search(Board &board, SearchLimiter &limiter);
 
+    /// Sets the number of best root moves reported with their own PV
+    /// \param lines number of PVs, at least 1
+    void set_multi_pv(int lines)
+    {
+        multi_pv = std::max(lines, 1);
+    }
+
     uint64_t get_nodes()
     {
         return nodes;
@@ -94,6 +94,12 @@ class Square
     {
         return color == Colors::BLACK ? index - dir : index + dir;
     }
+    template <Direction dir, Color color> constexpr Square shift() const
+    {
+        if constexpr (color == Colors::BLACK)
+            return index - dir;
+        return index + dir;
+    }
     friend std::ostream &operator<<(std::ostream &os, const Square &square)
     {
         os << static_cast<int>(square.index);
@@ -11,7 +11,8 @@ enum class TTBound : uint8_t
 {
     EXACT,
     LOWER,
-    UPPER
+    UPPER,
+    NONE // only the static eval is known
 };
 
 struct TTEntry
@@ -21,8 +22,22 @@ struct TTEntry
     Score score = 0;
     TTBound bound = TTBound::EXACT;
     Move best_move;
+    Score static_eval = -INF; // raw NNUE eval of the position, -INF if it wasn't computed
+    uint8_t generation = 0;   // search that wrote the entry, set by the table
 };
 
+// Mate scores are stored as the distance from the entry's position rather than from the root, so they stay
+// right when the position is reached at another ply or in a later search
+inline Score score_to_tt(Score score, int ply)
+{
+    return score >= MATE ? score + ply : score <= -MATE ? score - ply : score;
+}
+
+inline Score score_from_tt(Score score, int ply)
+{
+    return score >= MATE ? score - ply : score <= -MATE ? score + ply : score;
+}
+
 // Transposition table class
 class TranspositionTable
 {
@@ -30,6 +45,7 @@ class TranspositionTable
     static constexpr size_t TT_SIZE = 1 << 20; // can be modified!
 
     std::vector<TTEntry> table;
+    uint8_t generation = 0; // bumped by every search, the table is kept between the moves of a game
 
   public:
     TranspositionTable()
@@ -48,7 +64,7 @@ class TranspositionTable
         return static_cast<size_t>(key & (TT_SIZE - 1ULL));
     }
 
-    bool probe(uint64_t key, int depth, Score &out_score, TTBound &out_bound, Move &out_move)
+    bool probe(uint64_t key, int depth, Score &out_score, TTBound &out_bound, Move &out_move, Score &out_eval)
     {
         TTEntry &entry = table[index_of(key)];
         if (entry.key == key)
@@ -56,20 +72,47 @@ class TranspositionTable
             out_score = entry.score;
             out_bound = entry.bound;
             out_move = entry.best_move;
+            out_eval = entry.static_eval;
             return true;
         }
         return false;
     }
 
-    // Store a new entry in TT
-    void store(uint64_t key, int depth, Score score, TTBound bound, Move best_move)
+    // Start a new search, the entries of the earlier ones can always be replaced
+    void new_search()
+    {
+        generation++;
+    }
+
+    // Store a new entry in TT. Quiescence (depth 0) and eval-only (depth -1) entries are written at most nodes,
+    // so they don't push out a deeper entry from this search, otherwise the last entry wins. A store without a
+    // move or eval keeps the ones already known for the same position
+    void store(uint64_t key, int depth, Score score, TTBound bound, Move best_move, Score static_eval)
     {
         TTEntry &entry = table[index_of(key)];
+        if (depth <= 0 && entry.depth > depth && entry.generation == generation)
+            return;
+        const bool same_position = entry.key == key;
         entry.key = key;
         entry.depth = depth;
         entry.score = score;
         entry.bound = bound;
-        entry.best_move = best_move;
+        if (best_move || !same_position)
+            entry.best_move = best_move;
+        if (static_eval != -INF || !same_position)
+            entry.static_eval = static_eval;
+        entry.generation = generation;
+    }
+
+    // Store an entry found by another process, unless it would replace a deeper search of this one
+    void merge(const TTEntry &other)
+    {
+        TTEntry &entry = table[index_of(other.key)];
+        if (other.depth >= entry.depth || entry.generation != generation)
+        {
+            entry = other;
+            entry.generation = generation;
+        }
     }
 
     // Clear the table
@@ -1,14 +1,68 @@
 #pragma once
 #include "../tests/test_utils.h"
 #include "search.h"
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 namespace BBD::Engine::UCI
 {
 
+// Sets up the board from the arguments of a UCI position command
+void set_position(Board &board, std::istringstream &iss)
+{
+    std::string position_type;
+    while (iss >> position_type)
+    {
+        if (position_type == "startpos")
+        {
+            board.set_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        }
+        else if (position_type == "fen")
+        {
+            std::string fen;
+            for (int i = 0; i < 6; i++)
+            {
+                std::string temp;
+                iss >> temp;
+                fen += temp + " ";
+            }
+            board.set_fen(fen);
+        }
+        else if (position_type == "moves")
+        {
+            std::string move_str;
+            while (iss >> move_str)
+            {
+                MoveList moves;
+                int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
+                bool legal_move = false;
+
+                for (int i = 0; i < nr_moves; i++)
+                {
+                    if (!board.is_legal(moves[i]))
+                        continue;
+
+                    if (moves[i].to_string() == move_str)
+                    {
+                        board.make_move(moves[i]);
+                        legal_move = true;
+                        break;
+                    }
+                }
+                if (!legal_move)
+                {
+                    std::cout << "info got illegal move " << move_str << std::endl;
+                    break;
+                }
+            }
+        }
+    }
+}
+
 void uci_loop()
 {
     std::cout << "bbd by a team of very nice people!" << std::endl;
@@ -18,6 +72,17 @@ void uci_loop()
     SearchThread thread;
     limiter.set_depth(6);
 
+    // helper processes of a cluster search connect to this one once the Cluster option gives it a socket
+    ClusterNode cluster;
+    std::string position_command = "position startpos";
+
+    // the search runs on its own thread, so stop and ponderhit can reach it
+    std::thread searcher;
+    auto wait_for_search = [&searcher]() {
+        if (searcher.joinable())
+            searcher.join();
+    };
+
     std::string input;
     while (getline(std::cin, input))
     {
@@ -29,6 +94,9 @@ void uci_loop()
         {
             std::cout << "id name bbd" << std::endl;
             std::cout << "id author cool people" << std::endl;
+            std::cout << "option name Ponder type check default false" << std::endl;
+            std::cout << "option name MultiPV type spin default 1 min 1 max 256" << std::endl;
+            std::cout << "option name Cluster type string default <empty>" << std::endl;
 
             std::cout << "uciok" << std::endl;
         }
@@ -36,6 +104,7 @@ void uci_loop()
         {
             std::string parameter;
             uint64_t time = 0, inc = 0;
+            bool ponder = false;
 
             while (iss >> parameter)
             {
@@ -55,6 +124,10 @@ void uci_loop()
                 {
                     iss >> inc;
                 }
+                else if (parameter == "ponder")
+                {
+                    ponder = true;
+                }
                 else if (parameter == "depth")
                 {
                     int depth;
@@ -65,57 +138,58 @@ void uci_loop()
             if (time || inc)
                 limiter.set_time(time / 20 + inc / 2);
 
-            thread.search(board, limiter);
+            wait_for_search();
+            cluster.accept_peers();
+            const bool cluster_search = cluster.peer_count() && cluster.start_search(position_command);
+            if (cluster.peer_count() && !cluster_search)
+                std::cout << "info string position too long for the cluster, searching alone" << std::endl;
+            thread.set_cluster(cluster_search ? &cluster : nullptr, 0);
+
+            thread.prepare(ponder);
+            searcher = std::thread([&thread, &cluster, cluster_search, board, limiter]() mutable {
+                thread.search(board, limiter);
+                if (cluster_search)
+                    cluster.stop_peers();
+            });
         }
-        else if (command == "position")
+        else if (command == "ponderhit")
+        {
+            thread.ponderhit();
+        }
+        else if (command == "stop")
         {
-            std::string position_type;
-            while (iss >> position_type)
+            thread.stop();
+            wait_for_search();
+        }
+        else if (command == "ucinewgame")
+        {
+            wait_for_search();
+            thread.new_game();
+        }
+        else if (command == "setoption")
+        {
+            std::string token, name, value;
+            iss >> token; // name
+            while (iss >> token && token != "value")
+                name += (name.empty() ? "" : " ") + token;
+            iss >> value;
+
+            wait_for_search();
+            if (name == "MultiPV")
+                thread.set_multi_pv(std::atoi(value.c_str()));
+            else if (name == "Cluster")
             {
-                if (position_type == "startpos")
-                {
-                    board.set_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
-                }
-                else if (position_type == "fen")
-                {
-                    std::string fen;
-                    for (int i = 0; i < 6; i++)
-                    {
-                        std::string temp;
-                        iss >> temp;
-                        fen += temp + " ";
-                    }
-                    board.set_fen(fen);
-                }
-                else if (position_type == "moves")
-                {
-                    std::string move_str;
-                    while (iss >> move_str)
-                    {
-                        MoveList moves;
-                        int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
-                        bool legal_move = false;
-
-                        for (int i = 0; i < nr_moves; i++)
-                        {
-                            if (!board.is_legal(moves[i]))
-                                continue;
-
-                            if (moves[i].to_string() == move_str)
-                            {
-                                board.make_move(moves[i]);
-                                legal_move = true;
-                                break;
-                            }
-                        }
-                        if (!legal_move)
-                        {
-                            std::cout << "info got illegal move " << move_str << std::endl;
-                            break;
-                        }
-                    }
-                }
+                if (!cluster.listen(value))
+                    std::cout << "info string cannot listen on " << value << std::endl;
             }
+            else if (name != "Ponder") // pondering only depends on the GUI sending go ponder
+                std::cout << "info string unknown option " << name << std::endl;
+        }
+        else if (command == "position")
+        {
+            wait_for_search();
+            position_command = input;
+            set_position(board, iss);
         }
         else if (command == "perft")
         {
@@ -130,6 +204,8 @@ void uci_loop()
         }
         else if (command == "quit")
         {
+            thread.stop();
+            wait_for_search();
             exit(0);
         }
         else if (command == "eval")
@@ -137,6 +213,42 @@ void uci_loop()
             std::cout << NNUE::NNUENetwork::evaluate(board.get_accumulators(), board.get_color()) << '\n';
         }
     }
+
+    // end of input, let the last search answer
+    wait_for_search();
+}
+
+/// Runs a helper process of a cluster search until the main process goes away
+/// \param socket_path socket the main process listens on, given to it with the Cluster option
+void cluster_helper(const std::string &socket_path)
+{
+    ClusterNode cluster;
+    if (!cluster.connect(socket_path))
+    {
+        std::cerr << "Cannot connect to " << socket_path << "\n";
+        return;
+    }
+
+    // a helper only shares TT entries, its own results are not reported
+    SearchThread thread;
+    thread.set_quiet(true);
+    SearchLimiter limiter;
+    limiter.set_depth(MAX_DEPTH); // the main process stops the search
+
+    int rank;
+    std::string position_command;
+    while (cluster.wait_for_search(thread.get_tt(), rank, position_command))
+    {
+        Board board;
+        std::istringstream iss(position_command);
+        std::string command;
+        iss >> command;
+        set_position(board, iss);
+
+        thread.set_cluster(&cluster, rank);
+        thread.prepare(false);
+        thread.search(board, limiter);
+    }
 }
 
 } // namespace BBD::Engine::UCI
\ No newline at end of file
@@ -8,21 +8,36 @@ namespace BBD::Zobrist
 {
 
 inline std::array<uint64_t, 12 * 64> piece_square_keys;
-inline std::array<uint64_t, 4> castling_keys;
+inline std::array<uint64_t, 16> castling_keys; // one key per castling rights mask
 inline std::array<uint64_t, 64> en_passant_keys;
 
 inline uint64_t black_to_move;
 
+// one key per piece and count, a position's material key XORs the keys for counts 0 up to count - 1
+inline std::array<uint64_t, 12 * 16> material_keys;
+
 inline void init()
 {
     std::mt19937_64 rng(0xBEEF);
     for (auto &it : piece_square_keys)
         it = rng();
-    for (auto &it : castling_keys)
+    std::array<uint64_t, 4> castling_right_keys;
+    for (auto &it : castling_right_keys)
         it = rng();
+    for (int rights = 0; rights < 16; rights++)
+    {
+        castling_keys[rights] = 0;
+        for (int bit = 0; bit < 4; bit++)
+        {
+            if ((rights >> bit) & 1)
+                castling_keys[rights] ^= castling_right_keys[bit];
+        }
+    }
     for (auto &it : en_passant_keys)
         it = rng();
     black_to_move = rng();
+    for (auto &it : material_keys)
+        it = rng();
 }
 
 }; // namespace BBD::Zobrist
@@ -163,4 +163,43 @@ TEST_F(BoardTest, Promotion)
     board.undo_move(promote);
 
     EXPECT_EQ(board.at(Squares::E7), Pieces::WHITE_PAWN);
-}
\ No newline at end of file
+}
+
+TEST_F(BoardTest, CaptureResetsHalfMoveClock)
+{
+    board.set_fen("4k3/8/8/3r4/8/8/8/3RK3 w - - 7 40");
+    EXPECT_EQ(board.halfmoves_clock(), 7);
+
+    Move capture(Squares::D1, Squares::D5, NO_TYPE);
+    board.make_move(capture);
+    EXPECT_EQ(board.halfmoves_clock(), 0);
+
+    board.undo_move(capture);
+    EXPECT_EQ(board.halfmoves_clock(), 7);
+}
+TEST_F(BoardTest, FiftyMoveRule)
+{
+    BBD::attacks::init();
+    board.set_fen("4k3/8/8/3r4/8/8/8/3RK3 w - - 99 80");
+    EXPECT_FALSE(board.is_fifty_move_draw());
+    board.make_move(Move(Squares::E1, Squares::E2, NO_TYPE));
+    EXPECT_TRUE(board.is_fifty_move_draw());
+
+    // checkmate on the hundredth half move is still checkmate
+    board.set_fen("k7/1Q6/1K6/8/8/8/8/8 b - - 100 80");
+    EXPECT_FALSE(board.is_fifty_move_draw());
+}
+
+TEST_F(BoardTest, InsufficientMaterial)
+{
+    board.set_fen("8/8/4k3/8/8/3BK3/8/8 w - - 0 1");
+    EXPECT_TRUE(board.is_insufficient_material());
+    board.set_fen("8/8/4b3/4k3/8/3BK3/8/8 w - - 0 1");
+    EXPECT_TRUE(board.is_insufficient_material());
+    board.set_fen("8/8/3b4/4k3/8/3BK3/8/8 w - - 0 1");
+    EXPECT_FALSE(board.is_insufficient_material());
+    board.set_fen("8/8/4k3/8/8/2NNK3/8/8 w - - 0 1");
+    EXPECT_FALSE(board.is_insufficient_material());
+    board.set_fen("8/8/4k3/8/8/3PK3/8/8 w - - 0 1");
+    EXPECT_FALSE(board.is_insufficient_material());
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "../src/uci.h"
+#include "test_utils.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace BBD;
+using namespace BBD::Engine;
+
+TEST(ClusterTest, BatchesReachThePeer)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    ClusterNode sender, receiver;
+    sender.add_peer(fds[0]);
+    receiver.add_peer(fds[1]);
+    TranspositionTable tt;
+
+    // nothing is sent before the batch is full
+    const uint64_t key = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i + 1 < CLUSTER_BATCH_SIZE; i++)
+        sender.share(TTEntry{key * (i + 1), CLUSTER_SHARE_DEPTH, Score(i), TTBound::EXACT, NULL_MOVE, 0});
+    EXPECT_FALSE(receiver.poll(tt));
+    EXPECT_EQ(receiver.get_received_entries(), 0u);
+
+    sender.share(TTEntry{key * CLUSTER_BATCH_SIZE, CLUSTER_SHARE_DEPTH, 1, TTBound::LOWER, NULL_MOVE, 0});
+    EXPECT_FALSE(receiver.poll(tt));
+    EXPECT_EQ(receiver.get_received_entries(), CLUSTER_BATCH_SIZE);
+
+    Move move;
+    Score score = 0, eval;
+    TTBound bound;
+    ASSERT_TRUE(tt.probe(key * 3, 0, score, bound, move, eval));
+    EXPECT_EQ(score, 2);
+    EXPECT_EQ(bound, TTBound::EXACT);
+
+    sender.stop_peers();
+    EXPECT_TRUE(receiver.poll(tt));
+}
+
+TEST(ClusterTest, SearchAfterStopIsKept)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    ClusterNode sender, receiver;
+    sender.add_peer(fds[0]);
+    receiver.add_peer(fds[1]);
+    TranspositionTable tt;
+
+    // the next search can be queued right behind the stop of the last one
+    sender.stop_peers();
+    ASSERT_TRUE(sender.start_search("position startpos moves e2e4"));
+    EXPECT_TRUE(receiver.poll(tt));
+
+    int rank = 0;
+    std::string position_command;
+    ASSERT_TRUE(receiver.wait_for_search(tt, rank, position_command));
+    EXPECT_EQ(rank, 1);
+    EXPECT_EQ(position_command, "position startpos moves e2e4");
+}
+
+TEST(ClusterTest, OversizedMessagesAreRejected)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    ClusterNode sender, receiver;
+    sender.add_peer(fds[0]);
+    receiver.add_peer(fds[1]);
+    TranspositionTable tt;
+
+    std::string position_command = "position startpos moves";
+    while (position_command.size() < CLUSTER_MAX_MESSAGE_SIZE)
+        position_command += " g1f3 g8f6 f3g1 f6g8";
+    EXPECT_FALSE(sender.start_search(position_command));
+
+    // a message that doesn't fit the buffer is dropped, not cut off
+    std::vector<TTEntry> batch(CLUSTER_MAX_MESSAGE_SIZE / sizeof(TTEntry) + 1);
+    std::vector<char> message(sizeof(ClusterMessage) + batch.size() * sizeof(TTEntry));
+    const ClusterMessage type = ClusterMessage::TT_BATCH;
+    std::memcpy(message.data(), &type, sizeof(type));
+    ASSERT_EQ(send(fds[0], message.data(), message.size(), 0), static_cast<ssize_t>(message.size()));
+    EXPECT_FALSE(receiver.poll(tt));
+    EXPECT_EQ(receiver.get_received_entries(), 0u);
+    EXPECT_EQ(receiver.peer_count(), 1u);
+}
+
+TEST(ClusterTest, SharedEntryKeepsDeeperSearch)
+{
+    TranspositionTable tt;
+    tt.store(42, 10, 50, TTBound::EXACT, NULL_MOVE, 0);
+    tt.merge(TTEntry{42, 6, -50, TTBound::UPPER, NULL_MOVE, 0});
+    EXPECT_EQ(tt.entry_depth(42), 10);
+    tt.merge(TTEntry{42, 12, -50, TTBound::UPPER, NULL_MOVE, 0});
+    EXPECT_EQ(tt.entry_depth(42), 12);
+}
+
+TEST(ClusterTest, HelperProcessSharesEntries)
+{
+    BBD::Engine::init("../../drill/nnue_v1-100/quantised.bin");
+    const std::string path = "/tmp/bbd_cluster_test_" + std::to_string(getpid()) + ".sock";
+
+    pid_t helper;
+    {
+        ClusterNode cluster;
+        ASSERT_TRUE(cluster.listen(path));
+
+        helper = fork();
+        ASSERT_GE(helper, 0);
+        if (helper == 0)
+        {
+            UCI::cluster_helper(path);
+            _exit(0);
+        }
+
+        for (int i = 0; i < 1000 && !cluster.peer_count(); i++)
+        {
+            usleep(1000);
+            cluster.accept_peers();
+        }
+        ASSERT_EQ(cluster.peer_count(), 1u);
+
+        cluster.start_search("position startpos moves e2e4");
+        Board board("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1");
+        SearchLimiter limiter;
+        limiter.set_time(1000);
+        SearchThread thread;
+        thread.set_cluster(&cluster, 0);
+        thread.search(board, limiter);
+        cluster.stop_peers();
+
+        EXPECT_GT(cluster.get_received_entries(), 0u);
+    }
+
+    // the helper leaves once the main process closes the connection
+    int status;
+    ASSERT_EQ(waitpid(helper, &status, 0), helper);
+    EXPECT_TRUE(WIFEXITED(status));
+    unlink(path.c_str());
+}
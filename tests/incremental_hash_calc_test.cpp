@@ -278,4 +278,134 @@ TEST_F(IncrementalHashCalcTest, Promo2)
     uint64_t hash2 = board.hash_calc();
     uint64_t hash2_ = board.get_cur_hash();
     EXPECT_EQ(hash2, hash2_);
-}
\ No newline at end of file
+}
+
+TEST_F(IncrementalHashCalcTest, CastlingRightsRookCapture)
+{
+    board.set_fen("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1");
+
+    Move capture(Squares::H1, Squares::H8, NO_TYPE);
+    board.make_move(capture);
+
+    EXPECT_EQ(board.get_castling_rights(), 0b1010);
+    EXPECT_EQ(board.hash_calc(), board.get_cur_hash());
+
+    board.undo_move(capture);
+
+    EXPECT_EQ(board.get_castling_rights(), 0b1111);
+    EXPECT_EQ(board.hash_calc(), board.get_cur_hash());
+}
+
+// The pawn, material and non-pawn keys are updated incrementally like the hash
+class IncrementalKeysTest : public ::testing::Test
+{
+  protected:
+    Board board;
+
+    void SetUp() override
+    {
+        BBD::attacks::init();
+        BBD::Zobrist::init();
+        board = Board();
+    }
+
+    void expect_keys_match()
+    {
+        EXPECT_EQ(board.pawn_key_calc(), board.get_pawn_key());
+        EXPECT_EQ(board.material_key_calc(), board.get_material_key());
+        EXPECT_EQ(board.non_pawn_key_calc(Colors::WHITE), board.get_non_pawn_key(Colors::WHITE));
+        EXPECT_EQ(board.non_pawn_key_calc(Colors::BLACK), board.get_non_pawn_key(Colors::BLACK));
+    }
+
+    // walks every legal line up to depth plies, checking the keys after each make and undo
+    void walk(int depth)
+    {
+        if (depth == 0)
+            return;
+
+        MoveList moves;
+        int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
+        for (int i = 0; i < nr_moves; i++)
+        {
+            if (!board.is_legal(moves[i]))
+                continue;
+            board.make_move(moves[i]);
+            expect_keys_match();
+            walk(depth - 1);
+            board.undo_move(moves[i]);
+            expect_keys_match();
+        }
+    }
+};
+
+TEST_F(IncrementalKeysTest, PawnMove)
+{
+    uint64_t pawn_key = board.get_pawn_key(), material_key = board.get_material_key();
+    uint64_t white_key = board.get_non_pawn_key(Colors::WHITE);
+    Move pawn_move(Squares::E2, Squares::E4, NO_TYPE);
+    board.make_move(pawn_move);
+    expect_keys_match();
+    EXPECT_NE(pawn_key, board.get_pawn_key());
+    EXPECT_EQ(material_key, board.get_material_key());
+    EXPECT_EQ(white_key, board.get_non_pawn_key(Colors::WHITE));
+
+    board.undo_move(pawn_move);
+    expect_keys_match();
+    EXPECT_EQ(pawn_key, board.get_pawn_key());
+}
+
+TEST_F(IncrementalKeysTest, PieceMove)
+{
+    uint64_t pawn_key = board.get_pawn_key(), black_key = board.get_non_pawn_key(Colors::BLACK);
+    Move knight_move(Squares::B1, Squares::C3, NO_TYPE);
+    board.make_move(knight_move);
+    expect_keys_match();
+    EXPECT_EQ(pawn_key, board.get_pawn_key());
+    EXPECT_EQ(black_key, board.get_non_pawn_key(Colors::BLACK));
+}
+
+TEST_F(IncrementalKeysTest, CaptureChangesMaterial)
+{
+    board.set_fen("4k3/8/8/3r4/8/8/8/3RK3 w - - 0 1");
+    uint64_t material_key = board.get_material_key();
+    Move capture(Squares::D1, Squares::D5, NO_TYPE);
+    board.make_move(capture);
+    expect_keys_match();
+    EXPECT_NE(material_key, board.get_material_key());
+    EXPECT_EQ(board.get_non_pawn_key(Colors::BLACK), board.non_pawn_key_calc(Colors::BLACK));
+
+    board.undo_move(capture);
+    expect_keys_match();
+    EXPECT_EQ(material_key, board.get_material_key());
+}
+
+TEST_F(IncrementalKeysTest, SameMaterialSameKey)
+{
+    board.set_fen("4k3/8/8/3r4/8/8/8/3RK3 w - - 0 1");
+    uint64_t material_key = board.get_material_key();
+    board.set_fen("3rk3/8/8/8/8/8/8/R3K3 w - - 0 1");
+    EXPECT_EQ(material_key, board.get_material_key());
+}
+
+TEST_F(IncrementalKeysTest, PromotionAndEnPassant)
+{
+    board.set_fen("8/1P2k3/8/8/2pP4/8/8/4K3 b - d3 0 1");
+    expect_keys_match();
+    Move en_passant(Squares::C4, Squares::D3, ENPASSANT);
+    board.make_move(en_passant);
+    expect_keys_match();
+    Move promotion(Squares::B7, Squares::B8, PROMO_QUEEN);
+    board.make_move(promotion);
+    expect_keys_match();
+
+    board.undo_move(promotion);
+    board.undo_move(en_passant);
+    expect_keys_match();
+}
+
+TEST_F(IncrementalKeysTest, AllLinesFromKiwipete)
+{
+    board.set_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    expect_keys_match();
+    walk(3);
+}
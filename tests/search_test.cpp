@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 
 #include "test_utils.h"
+#include <atomic>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 using namespace BBD;
 using namespace BBD::Tests;
@@ -12,10 +15,102 @@ class SearchTest : public ::testing::Test
   protected:
     Board board;
 
+    // an info line of the search output
+    struct InfoLine
+    {
+        int multipv = 0, depth = 0;
+        int score = 0; // in centipawns, mates far beyond any eval
+        std::string bound;
+        std::vector<std::string> pv;
+    };
+
     void SetUp() override
     {
         board = Board();
     }
+
+    // splits the UCI output of a search into its info lines and the words of its bestmove line
+    static std::vector<InfoLine> parse_output(const std::string &output, std::vector<std::string> &bestmove)
+    {
+        std::vector<InfoLine> lines;
+        std::istringstream stream(output);
+        std::string text;
+        while (std::getline(stream, text))
+        {
+            std::istringstream iss(text);
+            std::string token;
+            iss >> token;
+            if (token == "bestmove")
+            {
+                bestmove.clear();
+                while (iss >> token)
+                    bestmove.push_back(token);
+                continue;
+            }
+            if (token != "info")
+                continue;
+
+            InfoLine line;
+            while (iss >> token)
+            {
+                if (token == "multipv")
+                    iss >> line.multipv;
+                else if (token == "depth")
+                    iss >> line.depth;
+                else if (token == "score")
+                {
+                    std::string unit;
+                    iss >> unit >> line.score;
+                    if (unit == "mate")
+                        line.score = line.score > 0 ? 100000 - line.score : -100000 - line.score;
+                }
+                else if (token == "upperbound" || token == "lowerbound")
+                    line.bound = token;
+                else if (token == "pv")
+                {
+                    while (iss >> token)
+                        line.pv.push_back(token);
+                }
+            }
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // whether every move of the line is legal, played from the given position
+    static bool is_legal_line(Board board, const std::vector<std::string> &line)
+    {
+        for (const std::string &text : line)
+        {
+            MoveList moves;
+            int nr_moves = board.gen_legal_moves<ALL_MOVES>(moves);
+            bool found = false;
+            for (int i = 0; i < nr_moves && !found; i++)
+            {
+                if (moves[i].to_string() == text && board.is_legal(moves[i]))
+                {
+                    board.make_move(moves[i]);
+                    found = true;
+                }
+            }
+            if (!found)
+                return false;
+        }
+        return true;
+    }
+
+    // searches the board to the given depth and returns what was printed
+    std::string search_output(int depth, int multi_pv = 1)
+    {
+        SearchLimiter limiter;
+        limiter.set_depth(depth);
+        SearchThread thread;
+        thread.set_multi_pv(multi_pv);
+
+        testing::internal::CaptureStdout();
+        thread.search(board, limiter);
+        return testing::internal::GetCapturedStdout();
+    }
 };
 
 TEST_F(SearchTest, TimeSearch1sec)
@@ -49,4 +144,106 @@ TEST_F(SearchTest, TimeSearch5sec)
     auto t = (get_time_since_start() - time_before) / 1000.0; // in seconds
     std::cerr << t;
     EXPECT_LE(t, 5);
-}
\ No newline at end of file
+}
+
+TEST_F(SearchTest, PrintedPVIsLegal)
+{
+    BBD::Engine::init("../../drill/nnue_v1-100/quantised.bin");
+    board = Board("rnbqkbnr/pppp1ppp/8/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 2");
+
+    std::vector<std::string> bestmove;
+    const std::vector<InfoLine> lines = parse_output(search_output(9), bestmove);
+    ASSERT_FALSE(lines.empty());
+    ASSERT_FALSE(bestmove.empty());
+
+    std::vector<std::string> last_pv;
+    int fail_lows = 0;
+    for (const InfoLine &line : lines)
+    {
+        ASSERT_FALSE(line.pv.empty());
+        EXPECT_TRUE(is_legal_line(board, line.pv));
+
+        // nothing raised alpha at a fail-low root, so the line shows the PV of the last search inside its window
+        if (line.bound == "upperbound")
+        {
+            EXPECT_EQ(line.pv, last_pv);
+            fail_lows++;
+        }
+        else if (line.bound.empty())
+            last_pv = line.pv;
+    }
+    EXPECT_GT(fail_lows, 0);
+
+    EXPECT_EQ(lines.back().depth, 9);
+    EXPECT_TRUE(lines.back().bound.empty());
+    EXPECT_EQ(bestmove[0], lines.back().pv[0]);
+    if (bestmove.size() == 3 && lines.back().pv.size() > 1)
+    {
+        EXPECT_EQ(bestmove[2], lines.back().pv[1]);
+    }
+}
+
+TEST_F(SearchTest, MultiPVLinesAreOrdered)
+{
+    BBD::Engine::init("../../drill/nnue_v1-100/quantised.bin");
+
+    std::vector<std::string> bestmove;
+    const std::vector<InfoLine> lines = parse_output(search_output(7, 3), bestmove);
+    ASSERT_FALSE(bestmove.empty());
+
+    // the last iteration reports every line once, best first
+    std::vector<InfoLine> last;
+    for (const InfoLine &line : lines)
+    {
+        if (line.depth == 7)
+            last.push_back(line);
+    }
+    ASSERT_EQ(last.size(), 3u);
+    for (size_t i = 0; i < last.size(); i++)
+    {
+        EXPECT_EQ(last[i].multipv, static_cast<int>(i + 1));
+        ASSERT_FALSE(last[i].pv.empty());
+        EXPECT_TRUE(is_legal_line(board, last[i].pv));
+        for (size_t j = 0; j < i; j++)
+        {
+            EXPECT_NE(last[i].pv[0], last[j].pv[0]);
+            EXPECT_GE(last[j].score, last[i].score);
+        }
+    }
+    EXPECT_EQ(bestmove[0], last[0].pv[0]);
+}
+
+TEST_F(SearchTest, PonderWaitsForPonderhit)
+{
+    BBD::Engine::init("../../drill/nnue_v1-100/quantised.bin");
+    board = Board("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3");
+    SearchLimiter limiter;
+    limiter.set_time(400);
+    SearchThread thread;
+
+    testing::internal::CaptureStdout();
+    std::atomic<bool> done = false;
+    Move best = NULL_MOVE;
+    thread.prepare(true);
+    std::thread searcher([&]() {
+        best = thread.search(board, limiter);
+        done = true;
+    });
+
+    // pondering has no time limit, so there is no answer well past the move time
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    EXPECT_FALSE(done);
+
+    // after the ponderhit the usual time limit applies, with the pondering time counting towards it
+    const auto ponderhit_time = get_time_since_start();
+    thread.ponderhit();
+    searcher.join();
+    EXPECT_LE(get_time_since_start() - ponderhit_time, 400 + 50);
+
+    std::vector<std::string> bestmove;
+    parse_output(testing::internal::GetCapturedStdout(), bestmove);
+    ASSERT_EQ(bestmove.size(), 3u);
+    EXPECT_EQ(bestmove[0], best.to_string());
+    EXPECT_EQ(bestmove[1], "ponder");
+    EXPECT_TRUE(is_legal_line(board, {bestmove[0], bestmove[2]}));
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "test_utils.h"
+
+using namespace BBD;
+using namespace BBD::Tests;
+
+class SEETest : public ::testing::Test
+{
+  protected:
+    Board board;
+
+    void SetUp() override
+    {
+        BBD::attacks::init();
+        board = Board();
+    }
+};
+
+TEST_F(SEETest, UndefendedPiece)
+{
+    using namespace Squares;
+    board.set_fen("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1");
+    Move move(E1, E5, NO_TYPE);
+    EXPECT_TRUE(board.see(move, 100));
+    EXPECT_FALSE(board.see(move, 101));
+}
+
+TEST_F(SEETest, QueenTakesDefendedPawn)
+{
+    using namespace Squares;
+    board.set_fen("4k3/8/2p5/3p4/8/8/3Q4/4K3 w - - 0 1");
+    Move move(D2, D5, NO_TYPE);
+    EXPECT_FALSE(board.see(move, 0));
+    EXPECT_TRUE(board.see(move, -800));
+}
+
+TEST_F(SEETest, XRayAttackers)
+{
+    using namespace Squares;
+    // the rook behind the rook decides the exchange
+    board.set_fen("1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1");
+    Move move(D3, E5, NO_TYPE);
+    EXPECT_FALSE(board.see(move, 0));
+
+    board.set_fen("3r2k1/8/8/3p4/8/8/3R4/3R2K1 w - - 0 1");
+    Move rook_takes(D2, D5, NO_TYPE);
+    EXPECT_TRUE(board.see(rook_takes, 100));
+    board.set_fen("3r2k1/3r4/8/3p4/8/8/3R4/3R2K1 w - - 0 1");
+    EXPECT_FALSE(board.see(rook_takes, 1));
+}
+
+TEST_F(SEETest, EnPassant)
+{
+    using namespace Squares;
+    board.set_fen("4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1");
+    EXPECT_TRUE(board.see(Move(E5, D6, ENPASSANT), 100));
+}
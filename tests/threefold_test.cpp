@@ -13,7 +13,9 @@ class ThreeFoldTest : public ::testing::Test
 
     void SetUp() override
     {
+        BBD::attacks::init();
         BBD::Zobrist::init();
+        BBD::Cuckoo::init();
         board = Board();
     }
 };
@@ -53,4 +55,36 @@ TEST_F(ThreeFoldTest, NonBasicStuff)
     EXPECT_FALSE(board.threefold_check());
     board.make_move(Move(D7, E7, NO_TYPE));
     EXPECT_TRUE(board.threefold_check());
-}
\ No newline at end of file
+}
+
+TEST_F(ThreeFoldTest, TwofoldInsideSearchTree)
+{
+    using namespace Squares;
+    board.set_fen("8/4k3/8/8/3QK3/8/8/8 w - - 0 1");
+    board.make_move(Move(D4, E5, NO_TYPE));
+    board.make_move(Move(E7, D7, NO_TYPE));
+    board.make_move(Move(E5, D4, NO_TYPE));
+    board.make_move(Move(D7, E7, NO_TYPE));
+
+    // the first occurrence is the root, 4 plies ago
+    EXPECT_FALSE(board.is_repetition(4));
+    EXPECT_TRUE(board.is_repetition(5));
+}
+TEST_F(ThreeFoldTest, UpcomingRepetition)
+{
+    using namespace Squares;
+    board.make_move(Move(B1, C3, NO_TYPE));
+    board.make_move(Move(B8, C6, NO_TYPE));
+    EXPECT_FALSE(board.has_upcoming_repetition(4));
+    board.make_move(Move(C3, B1, NO_TYPE));
+
+    // black can go back to the starting position with Nb8
+    EXPECT_TRUE(board.has_upcoming_repetition(4));
+    // but that position was only reached once before the root
+    EXPECT_FALSE(board.has_upcoming_repetition(0));
+
+    // a pawn move can't be undone
+    board.make_move(Move(C6, B8, NO_TYPE));
+    board.make_move(Move(E2, E4, NO_TYPE));
+    EXPECT_FALSE(board.has_upcoming_repetition(10));
+}
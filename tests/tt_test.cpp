@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include "test_utils.h"
+
+using namespace BBD;
+using namespace BBD::Engine;
+
+class TTTest : public ::testing::Test
+{
+  protected:
+    TranspositionTable tt;
+
+    // a key that lands in the same slot as key but belongs to another position
+    static uint64_t same_slot(uint64_t key)
+    {
+        return key + (1ull << 40);
+    }
+};
+
+TEST_F(TTTest, QuiescenceStoreKeepsDeeperEntry)
+{
+    const uint64_t key = 0x123456789abcull;
+    const Move move(Squares::E2, Squares::E4, NO_TYPE);
+    tt.store(key, 8, 35, TTBound::EXACT, move, 10);
+
+    tt.store(same_slot(key), 0, -200, TTBound::LOWER, NULL_MOVE, -200);
+    tt.store(same_slot(key), -1, 0, TTBound::NONE, NULL_MOVE, -200);
+
+    Score score = 0, eval = 0;
+    TTBound bound = TTBound::NONE;
+    Move tt_move = NULL_MOVE;
+    ASSERT_TRUE(tt.probe(key, 0, score, bound, tt_move, eval));
+    EXPECT_EQ(tt.entry_depth(key), 8);
+    EXPECT_EQ(score, 35);
+    EXPECT_EQ(bound, TTBound::EXACT);
+    EXPECT_EQ(tt_move, move);
+}
+
+TEST_F(TTTest, EvalOnlyStoreFillsEmptySlot)
+{
+    const uint64_t key = 0xfedcba987654ull;
+    tt.store(key, -1, 0, TTBound::NONE, NULL_MOVE, 42);
+    EXPECT_EQ(tt.entry_depth(key), -1);
+
+    // a quiescence entry replaces the eval-only one, but not the other way around
+    tt.store(key, 0, 50, TTBound::LOWER, NULL_MOVE, 42);
+    tt.store(same_slot(key), -1, 0, TTBound::NONE, NULL_MOVE, 7);
+    EXPECT_EQ(tt.entry_depth(key), 0);
+
+    Score score = 0, eval = 0;
+    TTBound bound = TTBound::NONE;
+    Move tt_move = NULL_MOVE;
+    ASSERT_TRUE(tt.probe(key, 0, score, bound, tt_move, eval));
+    EXPECT_EQ(bound, TTBound::LOWER);
+}
+
+TEST_F(TTTest, QuiescenceStoreKeepsSamePositionDeeperEntry)
+{
+    const uint64_t key = 0x3333ull;
+    const Move move(Squares::G1, Squares::F3, NO_TYPE);
+    tt.store(key, 7, 25, TTBound::LOWER, move, 15);
+    tt.store(key, 0, -300, TTBound::UPPER, NULL_MOVE, -INF);
+    EXPECT_EQ(tt.entry_depth(key), 7);
+
+    // an entry of an earlier search is replaced, but its move and eval still belong to the position
+    tt.new_search();
+    tt.store(key, 0, -300, TTBound::UPPER, NULL_MOVE, -INF);
+    EXPECT_EQ(tt.entry_depth(key), 0);
+
+    Score score = 0, eval = 0;
+    TTBound bound = TTBound::NONE;
+    Move tt_move = NULL_MOVE;
+    ASSERT_TRUE(tt.probe(key, 0, score, bound, tt_move, eval));
+    EXPECT_EQ(score, -300);
+    EXPECT_EQ(tt_move, move);
+    EXPECT_EQ(eval, 15);
+}
+
+TEST_F(TTTest, DeeperSearchReplacesEntry)
+{
+    const uint64_t key = 0x1111ull;
+    tt.store(key, 0, 10, TTBound::UPPER, NULL_MOVE, 10);
+    tt.store(same_slot(key), 3, 20, TTBound::LOWER, NULL_MOVE, 20);
+    EXPECT_EQ(tt.entry_depth(same_slot(key)), 3);
+}
+
+TEST_F(TTTest, OlderSearchIsReplaced)
+{
+    const uint64_t key = 0x2222ull;
+    tt.store(key, 12, 30, TTBound::EXACT, NULL_MOVE, 30);
+    tt.new_search();
+
+    // a deep entry of an earlier move no longer keeps the slot
+    tt.store(same_slot(key), 0, -40, TTBound::UPPER, NULL_MOVE, -40);
+    EXPECT_EQ(tt.entry_depth(same_slot(key)), 0);
+
+    tt.store(key, 12, 30, TTBound::EXACT, NULL_MOVE, 30);
+    tt.new_search();
+    tt.merge(TTEntry{same_slot(key), 6, -40, TTBound::UPPER, NULL_MOVE, -40});
+    EXPECT_EQ(tt.entry_depth(same_slot(key)), 6);
+
+    // once merged, the entry belongs to this search
+    tt.store(key, -1, 0, TTBound::NONE, NULL_MOVE, 5);
+    EXPECT_EQ(tt.entry_depth(same_slot(key)), 6);
+}
+
+TEST_F(TTTest, MateScoresAreStoredFromTheEntry)
+{
+    // mated 3 plies below a node at ply 5: stored as mated 3 plies from the entry
+    const Score mated = -INF + 8;
+    EXPECT_EQ(score_to_tt(mated, 5), -INF + 3);
+    EXPECT_EQ(score_from_tt(score_to_tt(mated, 5), 5), mated);
+
+    // read back at ply 1 of a later search, the mate is still 3 plies away
+    EXPECT_EQ(score_from_tt(score_to_tt(mated, 5), 1), -INF + 4);
+    EXPECT_EQ(score_from_tt(score_to_tt(INF - 6, 4), 2), INF - 4);
+
+    // other scores are kept as they are
+    EXPECT_EQ(score_to_tt(150, 7), 150);
+    EXPECT_EQ(score_from_tt(-150, 7), -150);
+}